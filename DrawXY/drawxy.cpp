@@ -2,17 +2,28 @@
 #include <vector>
 #include <numeric>
 #include <chrono>
+#include <cstdlib>
+#include <stdexcept>
 
 //#define PRINT_RESULT
 
 #include "drawxy_common.h"
-#include "drawxy_draw_funcs.h"
+#include "drawxy_dispatch.h"
 #include "drawxy_graph_funcs.h"
 #include "drawxy_run.h"
+#include "drawxy_shape_dsl.h"
+#include "drawxy_driver.h"
+#include "drawxy_tuning.h"
 
 
-int main()
+int main(int argc, char* argv[])
 {
+    // Options starting with -- run the non-interactive benchmark matrix
+    if (argc > 1 && std::string(argv[1]).compare(0, 2, "--") == 0)
+    {
+        return run_driver(argc, argv);
+    }
+
     // Parameters
     
     int size = 32;
@@ -25,9 +36,66 @@ int main()
 
     int loops = 10;
     int threads = 2;
+    int grain = 1;
 
     const graph_shape shape = graph_shape::CIRCLE;
-    const vectorization_level vec_level = vectorization_level::AVX2;
+    sampling_kernel kernel = sampling_kernel::ROW_SWEEP;
+    int accumulators = 0;
+    const cull_mode cull = cull_mode::NONE;
+
+    // Vectorization level is detected from the CPU, the first argument forces a level
+    const vectorization_level detected_level = detect_vec_level();
+    vectorization_level vec_level = detected_level;
+
+    if (argc > 1)
+    {
+        vec_level = select_vec_level(detected_level, (vectorization_level) std::atoi(argv[1]));
+    }
+
+    // The second argument is an optional shape expression, benchmarked against the compiled shape
+    shape_program program;
+    bool has_program = false;
+
+    if (argc > 2)
+    {
+        try
+        {
+            program = compile_shape(argv[2]);
+            has_program = true;
+        }
+        catch (const std::invalid_argument& e)
+        {
+            std::cout << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Settings saved by --tune replace the defaults, a level forced by the first argument is kept
+    const tuning_profile profile = load_profile(default_profile_path, cpu_brand_string());
+
+    if (const tuned_settings* tuned = profile.find(shape))
+    {
+        if (argc <= 1 && tuned->vec_level <= detected_level)
+            vec_level = tuned->vec_level;
+
+        kernel = tuned->kernel;
+        accumulators = tuned->accumulators;
+        threads = tuned->threads;
+        grain = tuned->grain;
+
+        std::cout << "Tuning profile:         " << default_profile_path << std::endl;
+    }
+
+    const auto make_params = [&](int samples, int run_threads)
+    {
+        run_params params(shape, vec_level, samples, size, run_threads, kernel, cull, grain);
+        params.accumulators = accumulators;
+        return params;
+    };
+
+    std::cout << "Detected vectorization: " << vec_level_to_string(detected_level) << std::endl;
+    std::cout << "Selected vectorization: " << vec_level_to_string(vec_level) << std::endl;
+    std::cout << std::endl;
 
     int size2 = size * size;
 
@@ -55,29 +123,50 @@ int main()
 
     long long result_single;
     long long result_multi;
+    long long result_program = 0;
 
     if (bt == bench_type::MULTISAMPLE)
     {
         int samples = std::exp2(12);
         
-        result_single = run_multisample_loop<shape>(run_params(vec_level, samples, size, 1), 5);
+        result_single = run_multisample_loop(make_params(samples, 1), 5).score;
 
-        result_multi = run_multisample_loop<shape>(run_params(vec_level, samples, size, threads), 5);
+        result_multi = run_multisample_loop(make_params(samples, threads), 5).score;
 
-        
+        if (has_program)
+        {
+            run_params params = make_params(samples, threads);
+            params.program = &program;
+
+            result_program = run_multisample_loop(params, 5).score;
+        }
     }
 
     else if (bt == bench_type::FIXED_TIME)
     {
         int samples = std::exp2(12);
 
-        result_single = run_fixedtime_loop<shape>(run_params(vec_level, samples, size, 1), 5000, 5);
+        result_single = run_fixedtime_loop(make_params(samples, 1), 5000, 5).score;
+
+        result_multi = run_fixedtime_loop(make_params(samples, threads), 5000, 5).score;
+
+        if (has_program)
+        {
+            run_params params = make_params(samples, threads);
+            params.program = &program;
 
-        result_multi = run_fixedtime_loop<shape>(run_params(vec_level, samples, size, threads), 5000, 5);
+            result_program = run_fixedtime_loop(params, 5000, 5).score;
+        }
     }
     
     std::cout << "All loops finished" << std::endl;
     std::cout << "ST Score:             " << result_single << std::endl;
     std::cout << "MT Score:             " << result_multi << std::endl;
     std::cout << "ST:MT Ratio:          " << ((double)result_multi / result_single) << std::endl;
+
+    if (has_program)
+    {
+        std::cout << "Program Score:        " << result_program << std::endl;
+        std::cout << "Program:MT Ratio:     " << ((double)result_program / result_multi) << std::endl;
+    }
 }
\ No newline at end of file
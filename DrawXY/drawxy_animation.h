@@ -0,0 +1,257 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cmath>
+#include <algorithm>
+
+#include "drawxy_common.h"
+#include "drawxy_structs.h"
+#include "drawxy_coverage.h"
+#include "drawxy_dispatch.h"
+#include "drawxy_graph_funcs.h"
+#include "drawxy_run.h"
+
+// Camera position on an animation path, zoom and center as in run_params
+struct view_keyframe
+{
+    double zoom;
+    double center_x;
+    double center_y;
+};
+
+// Frame buffers of an animation unless set, two let the next frame start while one finishes
+constexpr int default_frames_in_flight = 2;
+
+// Keyframes as zoom:x:y items separated by commas, the form the driver's --path takes
+inline std::string format_path(const std::vector<view_keyframe>& path)
+{
+    std::ostringstream out;
+    out.precision(17);
+
+    for (size_t k = 0; k < path.size(); k++)
+        out << (k > 0 ? "," : "") << path[k].zoom << ":" << path[k].center_x << ":" << path[k].center_y;
+
+    return out.str();
+}
+
+// Keyframes are spread evenly over the frames, the first and last frame show the first and last
+// keyframe. Zoom is interpolated geometrically so magnification changes at a constant rate, the
+// center linearly.
+inline std::vector<frame_view> animation_views(const std::vector<view_keyframe>& path, const int frames)
+{
+    std::vector<frame_view> views;
+    views.reserve(frames);
+
+    const int segments = (int)path.size() - 1;
+
+    for (int f = 0; f < frames; f++)
+    {
+        view_keyframe key = path.front();
+
+        if (segments > 0)
+        {
+            const double t = frames > 1 ? (double)f / (frames - 1) * segments : 0.0;
+            const int k = std::min((int)t, segments - 1);
+            const double u = t - k;
+
+            const view_keyframe& a = path[k];
+            const view_keyframe& b = path[k + 1];
+
+            key.zoom = a.zoom * std::pow(b.zoom / a.zoom, u);
+            key.center_x = a.center_x + (b.center_x - a.center_x) * u;
+            key.center_y = a.center_y + (b.center_y - a.center_y) * u;
+        }
+
+        const double scale = 4.0 / key.zoom;
+        views.push_back({ scale, scale, key.center_x - scale / 2, key.center_y - scale / 2 });
+    }
+
+    return views;
+}
+
+struct animation_run_result
+{
+    multisample_run_result render;
+    int frames = 0;
+    int frames_in_flight = 0;
+
+    latency_histogram frame_latency;
+    long long stall_time = 0;
+
+    // Mean coverage of each frame
+    std::vector<float> frame_avg;
+
+    double frames_per_second() const
+    {
+        return render.total_time > 0 ? frames * 1e9 / render.total_time : 0.0;
+    }
+
+    // Multisample score of one frame at the rate frames finish
+    long long score() const
+    {
+        return 1e13 * frames / render.total_time;
+    }
+};
+
+typedef std::function<void(int run, const animation_run_result& result)> animation_run_callback;
+
+// Renders every view once into the recycled buffers, one per frame in flight. Each frame's mean is
+// reduced on the worker that finished it, while other workers render the next frame.
+inline animation_run_result run_animation_single(const run_params params, const std::vector<frame_view>& views,
+    std::vector<coverage_buffer>& buffers)
+{
+    std::ostream& out = report_stream(params);
+
+    const long long size2 = params.size * params.size;
+
+    animation_run_result result;
+    result.frames = (int)views.size();
+    result.frames_in_flight = (int)buffers.size();
+    result.frame_avg.resize(views.size());
+
+    const unit_kernel calc = select_unit_kernel(params);
+    const classify_func classify = params.cull == cull_mode::INTERVAL && params.program == nullptr ? select_classify(params.vec_level, params.shape) : nullptr;
+    const coverage_sum_func coverage_sum = select_coverage_sum(params.vec_level, params.coverage);
+
+    // Written by whichever worker finishes a frame, each frame has its own slot
+    std::vector<long long> latencies(views.size());
+    std::vector<long long> stalls(views.size());
+
+    const animation_callback on_frame = [&](const animation_frame& frame, const coverage_buffer& graph)
+    {
+        const double sum = coverage_sum(graph.data(), graph.size());
+
+        result.frame_avg[frame.index] = (float)(sum / coverage_format_max(params.coverage) / size2);
+        latencies[frame.index] = frame.latency;
+        stalls[frame.index] = frame.stall_time;
+    };
+
+    apply_placement(params);
+
+    result.render = graph_animation_mt(calc, classify, params.size, params.samples, views, params.threads, params.grain, buffers,
+        on_frame, params.counters);
+
+    double sum_avg = 0.0;
+
+    for (size_t f = 0; f < views.size(); f++)
+    {
+        result.frame_latency.record(latencies[f]);
+        result.stall_time += stalls[f];
+        sum_avg += result.frame_avg[f];
+    }
+
+    result.render.avg_value = (float)(sum_avg / views.size());
+    result.render.graph_bytes = buffers.empty() ? 0 : buffers.front().bytes() * (long long)buffers.size();
+
+    const auto& render = result.render;
+    const auto& latency = result.frame_latency;
+
+    out << "Score:                " << result.score() << std::endl;
+    out << "Total time:           " << render.total_time / 1e6 << " ms" << std::endl;
+    out << "Frame rate:           " << result.frames_per_second() << " frames/s" << std::endl;
+    out << "Frame latency p50:    " << latency.percentile(50) / 1e6 << " ms" << std::endl;
+    out << "Frame latency p90:    " << latency.percentile(90) / 1e6 << " ms" << std::endl;
+    out << "Frame latency p99:    " << latency.percentile(99) / 1e6 << " ms" << std::endl;
+    out << "Frame latency max:    " << latency.max / 1e6 << " ms" << std::endl;
+    out << "Buffer stall time:    " << result.stall_time / 1e6 << " ms" << std::endl;
+    out << "Frame buffers:        " << result.frames_in_flight << " (" << render.graph_bytes / 1e6 << " MB, recycled)" << std::endl;
+    print_graph_memory(out, render.memory);
+    out << "Avg value:            " << render.avg_value << " (first frame " << result.frame_avg.front()
+        << ", last frame " << result.frame_avg.back() << ")" << std::endl;
+    out << "Performance:          " << params.total_calculations() * result.frames * 1e9 / render.total_time << " calc/s" << std::endl;
+
+    if (classify != nullptr)
+    {
+        out << "Skipped units:        " << render.inside_units + render.outside_units << " / " << size2 * result.frames
+            << " (" << render.inside_units << " inside, " << render.outside_units << " outside)" << std::endl;
+    }
+
+    if (params.counters)
+        print_counters(out, render.counters, render.counter_error,
+            (double)(size2 * result.frames - render.inside_units - render.outside_units) * params.samples * params.samples);
+
+    out << "Unit time p50:        " << render.unit_latency.percentile(50) / 1e6 << " ms" << std::endl;
+    out << "Unit time p99:        " << render.unit_latency.percentile(99) / 1e6 << " ms" << std::endl;
+
+    for (int t = 0; t < (int)render.per_thread.size(); t++)
+    {
+        const auto& ts = render.per_thread[t];
+
+        out << "  Thread " << t << ":           " << ts.units << " units, busy " << ts.busy_time / 1e6
+            << " ms, idle " << (render.total_time - ts.busy_time) / 1e6 << " ms" << std::endl;
+    }
+
+    out << std::endl;
+
+    return result;
+}
+
+// Renders the path count times. The frame buffers are allocated once for the whole loop.
+inline score_summary run_animation_loop(const run_params params, const std::vector<view_keyframe>& path, const int frames,
+    const int frames_in_flight, const int count, const animation_run_callback& on_run = nullptr)
+{
+    std::ostream& out = report_stream(params);
+
+    const std::vector<frame_view> views = animation_views(path, frames);
+    std::vector<coverage_buffer> buffers(frames_in_flight, coverage_buffer(params.coverage));
+
+    out << "Animation Benchmark" << std::endl;
+    out << "Shape:                " << shape_name(params) << std::endl;
+    out << "Vectorization level:  " << vec_level_to_string(params.vec_level) << std::endl;
+    out << "Sampling kernel:      " << kernel_name(params) << std::endl;
+    out << "Precision:            " << precision_mode_to_string(effective_precision(params)) << std::endl;
+    out << "Path:                 " << path.size() << (path.size() == 1 ? " keyframe" : " keyframes") << std::endl;
+
+    for (const auto& key : path)
+        out << "  zoom " << key.zoom << " at (" << key.center_x << ", " << key.center_y << ")" << std::endl;
+
+    if (params.program == nullptr && is_escape_shape(params.shape))
+        out << "Max iterations:       " << params.max_iterations << std::endl;
+
+    out << "Unit culling:         " << cull_mode_to_string(params.program != nullptr ? cull_mode::NONE : params.cull) << std::endl;
+    out << "Frames:               " << frames << std::endl;
+    out << "Frames in flight:     " << frames_in_flight << std::endl;
+    out << "Samples Per Unit:     " << params.samples << std::endl;
+    out << "Display Size:         " << params.size << std::endl;
+    out << "Threads:              " << params.threads << std::endl;
+    out << "Thread placement:     " << thread_placement_to_string(params.placement) << std::endl;
+    out << "Graph pool:           " << (params.graph_pool ? "On [graphs reused across runs]" : "Off [every run maps and faults its graphs]") << std::endl;
+    out << "Chunk grain:          " << params.grain << " units" << std::endl;
+    out << "Runs:                 " << count << std::endl;
+    out << "Warmup runs:          " << params.loop.warmup << std::endl;
+    out << "Hardware counters:    " << (params.counters ? "On" : "Off") << std::endl;
+    out << std::endl;
+
+    double sum_fps = 0.0;
+    double best_fps = 0.0;
+    int measured = 0;
+
+    const score_summary summary = repeat_runs(params, count, [&](int i)
+    {
+        const animation_run_result result = run_animation_single(params, views, buffers);
+
+        if (i < 0)
+            return result.score();
+
+        if (on_run)
+            on_run(i, result);
+
+        sum_fps += result.frames_per_second();
+        best_fps = std::max(best_fps, result.frames_per_second());
+        measured++;
+
+        return result.score();
+    });
+
+    out << "Loop finished" << std::endl;
+    print_score_summary(out, params, summary);
+    out << "Avg frame rate:       " << sum_fps / measured << " frames/s" << std::endl;
+    out << "Best frame rate:      " << best_fps << " frames/s" << std::endl;
+    out << std::endl;
+
+    return summary;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <functional>
+
+#include "drawxy_common.h"
+#include "drawxy_structs.h"
+#include "drawxy_coverage.h"
+#include "drawxy_dispatch.h"
+#include "drawxy_graph_funcs.h"
+#include "drawxy_run.h"
+
+// One shape of a batched run, against a run of the shape alone over the same row sweep samples
+struct batch_shape_result
+{
+    graph_shape shape;
+    float avg_value;
+    long long separate_time;
+
+    // The batch graph of the shape equals the graph of its separate run
+    bool matches;
+};
+
+struct batch_run_result
+{
+    multisample_run_result batch;
+    std::vector<batch_shape_result> shapes;
+    long long separate_total_time = 0;
+
+    double speedup() const
+    {
+        return batch.total_time > 0 ? (double)separate_total_time / batch.total_time : 0.0;
+    }
+};
+
+typedef std::function<void(int run, const batch_run_result& result)> batch_callback;
+
+// Shapes a batch can hold, in single precision only
+inline bool is_batch_shape(graph_shape shape)
+{
+    return (int)shape < batch_shape_count;
+}
+
+inline double graph_mean(const run_params& params, const coverage_buffer& graph)
+{
+    const double sum = select_coverage_sum(params.vec_level, params.coverage)(graph.data(), graph.size());
+
+    return sum / coverage_format_max(params.coverage) / graph.size();
+}
+
+// Renders all shapes in one batch, then each shape alone with its row sweep kernel. Neither culls
+// nor mirrors units, so the times compare the shared coordinate pass with one pass per shape.
+inline batch_run_result run_batch_single(const run_params params, const std::vector<graph_shape>& shapes)
+{
+    std::ostream& out = report_stream(params);
+
+    const double samples_per_shape = (double)params.total_calculations();
+
+    batch_run_result result;
+    std::vector<coverage_buffer> graphs(shapes.size(), coverage_buffer(params.coverage));
+
+    apply_placement(params);
+
+    result.batch = graph_multisample_batch(select_calc_batch(params.vec_level), shapes, params.size, params.samples,
+        params.view_scale(), params.view_scale(), params.view_offset_x(), params.view_offset_y(), params.threads, params.grain, graphs);
+
+    for (size_t k = 0; k < shapes.size(); k++)
+    {
+        coverage_buffer graph(params.coverage);
+
+        const multisample_run_result separate = graph_multisample_mt(select_calc_avg(params.vec_level, sampling_kernel::ROW_SWEEP, shapes[k]),
+            nullptr, params.size, params.samples, params.view_scale(), params.view_scale(), params.view_offset_x(), params.view_offset_y(),
+            params.threads, params.grain, graph);
+
+        bool matches = true;
+        for (long long i = 0; i < graph.size() && matches; i++)
+            matches = graph.load(i) == graphs[k].load(i);
+
+        result.shapes.push_back({ shapes[k], (float)graph_mean(params, graphs[k]), separate.total_time, matches });
+        result.separate_total_time += separate.total_time;
+    }
+
+    const double batch_time = (double)result.batch.total_time;
+
+    out << "Score:                " << result.batch.score() << std::endl;
+    out << "Batch time:           " << batch_time / 1e6 << " ms" << std::endl;
+    out << "Separate time:        " << result.separate_total_time / 1e6 << " ms (" << shapes.size() << " shapes run alone)" << std::endl;
+    out << "Batch speedup:        " << result.speedup() << "x" << std::endl;
+    out << "Batched rate:         " << samples_per_shape * shapes.size() * 1e9 / batch_time << " shape samples/s" << std::endl;
+
+    for (const auto& s : result.shapes)
+    {
+        out << "  " << graph_shape_to_string(s.shape) << std::endl;
+        out << "    avg " << s.avg_value << ", batched " << samples_per_shape * 1e9 / batch_time << " samples/s, alone "
+            << samples_per_shape * 1e9 / s.separate_time << " samples/s" << (s.matches ? "" : " [GRAPHS DIFFER]") << std::endl;
+    }
+
+    out << std::endl;
+
+    return result;
+}
+
+inline score_summary run_batch_loop(const run_params params, const std::vector<graph_shape>& shapes, const int count,
+    const batch_callback& on_run = nullptr)
+{
+    std::ostream& out = report_stream(params);
+
+    out << "Batch Benchmark" << std::endl;
+    out << "Shapes:               " << shapes.size() << std::endl;
+
+    for (const graph_shape shape : shapes)
+        out << "  " << graph_shape_to_string(shape) << std::endl;
+
+    out << "Vectorization level:  " << vec_level_to_string(params.vec_level) << std::endl;
+    out << "Sampling kernel:      " << sampling_kernel_to_string(sampling_kernel::ROW_SWEEP) << ", shared by the batch" << std::endl;
+    out << "View:                 zoom " << params.zoom << " at (" << params.center_x << ", " << params.center_y << ")" << std::endl;
+    out << "Samples Per Unit:     " << params.samples << std::endl;
+    out << "Display Size:         " << params.size << std::endl;
+    out << "Threads:              " << params.threads << std::endl;
+    out << "Chunk grain:          " << params.grain << " units" << std::endl;
+    out << "Runs:                 " << count << std::endl;
+    out << "Warmup runs:          " << params.loop.warmup << std::endl;
+    out << std::endl;
+
+    double sum_speedup = 0.0;
+    int measured = 0;
+
+    const score_summary summary = repeat_runs(params, count, [&](int i)
+    {
+        const batch_run_result result = run_batch_single(params, shapes);
+
+        if (i < 0)
+            return result.batch.score();
+
+        if (on_run)
+            on_run(i, result);
+
+        sum_speedup += result.speedup();
+        measured++;
+
+        return result.batch.score();
+    });
+
+    out << "Loop finished" << std::endl;
+    print_score_summary(out, params, summary);
+    out << "Avg batch speedup:    " << sum_speedup / measured << "x" << std::endl;
+    out << std::endl;
+
+    return summary;
+}
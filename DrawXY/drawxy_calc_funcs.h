@@ -0,0 +1,1476 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+
+#include "drawxy_common.h"
+#include "drawxy_draw_funcs.h"
+#include "drawxy_csg.h"
+#include "drawxy_structs.h"
+#include "drawxy_shape_dsl.h"
+
+#ifdef VCL_NAMESPACE
+namespace VCL_NAMESPACE {
+#endif
+
+template <typename T> const std::vector<float> graph_single(const T(*func)(T, T), const int size, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y);
+
+template <> const std::vector<float> graph_single<float>(const float(*func)(float, float), const int size, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    const int size2 = size * size;
+
+    std::vector<float> result(size2);
+
+    for (int i = 0; i < size2; i++)
+    {
+        // Calculate coordinates from index
+        const int cx = i % size;
+        const int cy = i / size;
+
+        const float x = (float)cx / size * scale_x + offset_x;
+        const float y = (float)cy / size * scale_y + offset_y;
+
+        result[i] = func(x, y);
+    }
+
+    return result;
+}
+
+template <> const std::vector<float> graph_single<Vec8f>(const Vec8f(*func)(Vec8f, Vec8f), const int size, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    static constexpr int group_size = 8;
+
+    const int size2 = size * size;
+
+    const Vec8f size_v(size);
+    const Vec8f scale_x_v(scale_x);
+    const Vec8f scale_y_v(scale_y);
+    const Vec8f offset_x_v(offset_x);
+    const Vec8f offset_y_v(offset_y);
+
+    const Vec8f scale_x_o_size_v = scale_x_v / size_v;
+    const Vec8f scale_y_o_size_v = scale_y_v / size_v;
+
+    std::vector<float> result(size2);
+
+    for (int i = 0; i < size2; i += group_size)
+    {
+        Vec8f i_v(i);
+        i_v += ci_v8;
+
+        // x vector
+        // cx = i % size = i - roundto0(i / size) * size
+        // x = cx / size * scale_x + offset_x
+        Vec8f x_v = i_v;
+
+        x_v = x_v / size_v;
+        x_v = truncate(x_v);
+        x_v = nmul_add(x_v, size_v, i_v);
+
+        x_v = mul_add(x_v, scale_x_o_size_v, offset_x_v);
+
+        // y vector
+        // cy = i / size
+        // y = cy / size * scale_y + offset_y
+        Vec8f y_v = i_v;
+
+        y_v = y_v / size_v;
+
+        y_v = mul_add(y_v, scale_y_o_size_v, offset_y_v);
+
+        // Result
+        Vec8f r_v = func(x_v, y_v);
+
+        r_v.store(&result[i]);
+    }
+
+    return result;
+}
+
+template <graph_shape shape> const float calc_avg_s(const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    const int samples2 = samples * samples;
+
+    float avg = 0.0f;
+
+    for (int i = 0; i < samples2; i++)
+    {
+        // Calculate coordinates from index
+        const int cx = i % samples;
+        const int cy = i / samples;
+
+        const float x = (float)cx / samples * scale_x + offset_x;
+        const float y = (float)cy / samples * scale_y + offset_y;
+
+        avg += draw_func<float, shape>(x, y);
+    }
+
+    return avg / samples2;
+}
+
+template <graph_shape shape> const float calc_avg_v4(const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    static constexpr int group_size = 4;
+
+    const int samples2 = samples * samples;
+
+    const Vec4f size_v(samples);
+    const Vec4f scale_x_v(scale_x);
+    const Vec4f scale_y_v(scale_y);
+    const Vec4f offset_x_v(offset_x);
+    const Vec4f offset_y_v(offset_y);
+
+    const Vec4f scale_x_o_size_v = scale_x_v / size_v;
+    const Vec4f scale_y_o_size_v = scale_y_v / size_v;
+
+    float avg = 0.0f;
+    Vec4f sum_v(0);
+
+#pragma clang loop unroll(disable)
+    for (int i = 0; i < samples2; i += group_size)
+    {
+        Vec4f i_v(i);
+        i_v += ci_v4;
+
+        // x vector
+        // cx = i % size = i - roundto0(i / size) * size
+        // x = cx / size * scale_x + offset_x
+        Vec4f x_v = i_v;
+
+        // y vector
+        // cy = i / size
+        // y = cy / size * scale_y + offset_y
+        Vec4f y_v = i_v;
+
+        x_v /= size_v;
+        y_v /= size_v;
+
+        x_v = truncate(x_v);
+        x_v = nmul_add(x_v, size_v, i_v);
+
+        x_v = mul_add(x_v, scale_x_o_size_v, offset_x_v);
+        
+        y_v = mul_add(y_v, scale_y_o_size_v, offset_y_v);
+
+        // Result
+        Vec4f r_v = draw_func<Vec4f, shape>(x_v, y_v);
+        sum_v += r_v;
+    }
+
+    avg = horizontal_add(sum_v) / samples2;
+    return avg;
+}
+
+template <graph_shape shape> const float calc_avg_v8(const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    static constexpr int group_size = 8;
+
+    const int samples2 = samples * samples;
+
+    const Vec8f size_v(samples);
+    const Vec8f scale_x_v(scale_x);
+    const Vec8f scale_y_v(scale_y);
+    const Vec8f offset_x_v(offset_x);
+    const Vec8f offset_y_v(offset_y);
+
+    const Vec8f scale_x_o_size_v = scale_x_v / size_v;
+    const Vec8f scale_y_o_size_v = scale_y_v / size_v;
+
+    float avg = 0.0f;
+    Vec8f sum_v(0);
+
+#pragma clang loop unroll(disable)
+    for (int i = 0; i < samples2; i += group_size)
+    {
+        Vec8f i_v(i);
+        i_v += ci_v8;
+
+        // x vector
+        // cx = i % size = i - roundto0(i / size) * size
+        // x = cx / size * scale_x + offset_x
+        Vec8f x_v = i_v;
+
+        // y vector
+        // cy = i / size
+        // y = cy / size * scale_y + offset_y
+        Vec8f y_v = i_v;
+
+        x_v /= size_v;
+        y_v /= size_v;
+
+        x_v = truncate(x_v);
+        x_v = nmul_add(x_v, size_v, i_v);
+
+        x_v = mul_add(x_v, scale_x_o_size_v, offset_x_v);
+        
+        y_v = mul_add(y_v, scale_y_o_size_v, offset_y_v);
+
+        // Result
+        Vec8f r_v = draw_func<Vec8f, shape>(x_v, y_v);
+        sum_v += r_v;
+    }
+
+    avg = horizontal_add(sum_v) / samples2;
+    return avg;
+}
+
+template <graph_shape shape> const float calc_avg_v16(const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    static constexpr int group_size = 16;
+
+    const int samples2 = samples * samples;
+
+    const Vec16f size_v(samples);
+    const Vec16f scale_x_v(scale_x);
+    const Vec16f scale_y_v(scale_y);
+    const Vec16f offset_x_v(offset_x);
+    const Vec16f offset_y_v(offset_y);
+
+    const Vec16f scale_x_o_size_v = scale_x_v / size_v;
+    const Vec16f scale_y_o_size_v = scale_y_v / size_v;
+
+    float avg = 0.0f;
+    Vec16f sum_v(0);
+
+#pragma clang loop unroll(disable)
+    for (int i = 0; i < samples2; i += group_size)
+    {
+        Vec16f i_v(i);
+        i_v += ci_v16;
+
+        // x vector
+        // cx = i % size = i - roundto0(i / size) * size
+        // x = cx / size * scale_x + offset_x
+        Vec16f x_v = i_v;
+
+        // y vector
+        // cy = i / size
+        // y = cy / size * scale_y + offset_y
+        Vec16f y_v = i_v;
+
+        x_v /= size_v;
+        y_v /= size_v;
+
+        x_v = truncate(x_v);
+        x_v = nmul_add(x_v, size_v, i_v);
+
+        x_v = mul_add(x_v, scale_x_o_size_v, offset_x_v);
+        
+        y_v = mul_add(y_v, scale_y_o_size_v, offset_y_v);
+
+        // Result
+        Vec16f r_v = draw_func<Vec16f, shape>(x_v, y_v);
+        sum_v += r_v;
+    }
+
+    avg = horizontal_add(sum_v) / samples2;
+    return avg;
+}
+
+template <graph_shape shape> const float calc_avg_rows_s(const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    const float step_x = scale_x / samples;
+    const float step_y = scale_y / samples;
+
+    long long count = 0;
+
+    for (int cy = 0; cy < samples; cy++)
+    {
+        const float y = (float)cy * step_y + offset_y;
+
+        for (int cx = 0; cx < samples; cx++)
+        {
+            const float x = (float)cx * step_x + offset_x;
+
+            count += draw_mask<float, shape>(x, y);
+        }
+    }
+
+    return (float)((double)count / ((long long)samples * samples));
+}
+
+// Samples are swept row by row: y is fixed per row and x advances by a constant per vector, so no
+// division is needed to recover coordinates. Hits are counted per vector through the mask popcount
+// into independent integer accumulators, which keeps the count exact for any number of samples.
+template <typename V, graph_shape shape, int accumulators> const float calc_avg_rows_v(const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    static constexpr int group_size = V::size();
+    static constexpr int block_size = group_size * accumulators;
+
+    const int block_end = samples - samples % block_size;
+
+    V ci_v;
+    for (int i = 0; i < group_size; i++)
+    {
+        ci_v.insert(i, (float)i);
+    }
+
+    const V samples_v((float)samples);
+    const V step_x_v(scale_x / samples);
+    const V step_y_v(scale_y / samples);
+    const V offset_x_v(offset_x);
+    const V offset_y_v(offset_y);
+
+    long long count[accumulators] = {};
+
+    for (int cy = 0; cy < samples; cy++)
+    {
+        const V y_v = mul_add(V((float)cy), step_y_v, offset_y_v);
+
+        // Column indices stay exact integers in float up to 2^24
+        V cx_v = ci_v;
+
+        for (int cx = 0; cx < block_end; cx += block_size)
+        {
+            for (int a = 0; a < accumulators; a++)
+            {
+                const V x_v = mul_add(cx_v + V((float)(a * group_size)), step_x_v, offset_x_v);
+
+                count[a] += horizontal_count(draw_mask<V, shape>(x_v, y_v));
+            }
+
+            cx_v += V((float)block_size);
+        }
+
+        for (int cx = block_end; cx < samples; cx += group_size)
+        {
+            const V x_v = mul_add(cx_v, step_x_v, offset_x_v);
+
+            count[0] += horizontal_count(draw_mask<V, shape>(x_v, y_v) && (cx_v < samples_v));
+
+            cx_v += V((float)group_size);
+        }
+    }
+
+    long long sum = 0;
+    for (int a = 0; a < accumulators; a++)
+    {
+        sum += count[a];
+    }
+
+    return (float)((double)sum / ((long long)samples * samples));
+}
+
+template <vectorization_level vl, graph_shape shape> constexpr float calc_avg(const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    if constexpr (vl == vectorization_level::NONE)
+    {
+        return calc_avg_s<shape>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::SSE4)
+    {
+        return calc_avg_v4<shape>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX2)
+    {
+        return calc_avg_v8<shape>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX512)
+    {
+        return calc_avg_v16<shape>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+}
+
+// Unit rectangle [offset, offset + scale] of each axis through draw_bounds
+template <graph_shape shape> unit_class classify_unit(const double scale_x, const double scale_y,
+    const double offset_x, const double offset_y)
+{
+    const interval x_i = { offset_x, offset_x + scale_x };
+    const interval y_i = { offset_y, offset_y + scale_y };
+
+    return draw_bounds<shape>(x_i, y_i);
+}
+
+// Independent hit accumulators in calc_avg_rows_v, other counts are built as row sweep variants
+constexpr int row_sweep_accumulators = row_sweep_variant_accumulators[2];
+
+template <vectorization_level vl, graph_shape shape, int accumulators = row_sweep_accumulators> constexpr float calc_avg_rows(const int samples,
+    const float scale_x, const float scale_y, const float offset_x, const float offset_y)
+{
+    if constexpr (vl == vectorization_level::NONE)
+    {
+        return calc_avg_rows_s<shape>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::SSE4)
+    {
+        return calc_avg_rows_v<Vec4f, shape, accumulators>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX2)
+    {
+        return calc_avg_rows_v<Vec8f, shape, accumulators>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX512)
+    {
+        return calc_avg_rows_v<Vec16f, shape, accumulators>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+}
+
+// Column of a unit closest to x = 0. Sample x rises with the column and rounding keeps it monotone,
+// so |x| falls up to this column and rises after it, and the hits of a span shape's row are one run
+// of columns containing it.
+inline int span_center_column(const int samples, const float step_x, const float offset_x)
+{
+    const double c = std::clamp(std::floor(-(double)offset_x / step_x), 0.0, (double)(samples - 1));
+
+    int center = (int)c;
+
+    // The division can land one column off the rounded coordinates' minimum
+    for (const int n : { center - 1, center + 1 })
+    {
+        if (n >= 0 && n < samples && std::abs((float)n * step_x + offset_x) < std::abs((float)center * step_x + offset_x))
+            center = n;
+    }
+
+    return center;
+}
+
+// Column of coordinate x clamped to [lo, hi], rounded down or up
+inline int span_column(const double x, const float step_x, const float offset_x, const bool round_up, const int lo, const int hi)
+{
+    const double c = (x - offset_x) / step_x;
+
+    return (int)std::clamp(round_up ? std::ceil(c) : std::floor(c), (double)lo, (double)hi);
+}
+
+// Exact hit count of a span shape in O(samples) per unit: per row, the run of hit columns around
+// the center column is estimated from the shape's half width and its ends are walked to the last
+// columns where draw_mask holds, usually one or two steps.
+template <graph_shape shape> const float calc_avg_span_s(const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    const float step_x = scale_x / samples;
+    const float step_y = scale_y / samples;
+
+    const int center = span_center_column(samples, step_x, offset_x);
+    const float x_center = (float)center * step_x + offset_x;
+
+    const auto hit = [&](const int cx, const float y) { return (bool)draw_mask<float, shape>((float)cx * step_x + offset_x, y); };
+
+    long long count = 0;
+
+    for (int cy = 0; cy < samples; cy++)
+    {
+        const float y = (float)cy * step_y + offset_y;
+
+        if (!draw_mask<float, shape>(x_center, y))
+            continue;
+
+        const double r = std::sqrt(std::max((double)shape_span<shape>::half_width_sq(y), 0.0));
+
+        int hi = span_column(r, step_x, offset_x, false, center, samples - 1);
+        int lo = span_column(-r, step_x, offset_x, true, 0, center);
+
+        while (hi + 1 < samples && hit(hi + 1, y))
+            hi++;
+        while (!hit(hi, y))
+            hi--;
+
+        while (lo > 0 && hit(lo - 1, y))
+            lo--;
+        while (!hit(lo, y))
+            lo++;
+
+        count += hi - lo + 1;
+    }
+
+    return (float)((double)count / ((long long)samples * samples));
+}
+
+// calc_avg_span_s with one row per lane. Column ends are kept as exact integers in float and
+// walked together, lanes that are done or missed their row stay put.
+template <typename V, graph_shape shape> const float calc_avg_span_v(const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    static constexpr int group_size = V::size();
+
+    V ci_v;
+    for (int i = 0; i < group_size; i++)
+    {
+        ci_v.insert(i, (float)i);
+    }
+
+    const float step_x = scale_x / samples;
+    const int center = span_center_column(samples, step_x, offset_x);
+
+    const V samples_v((float)samples);
+    const V last_v((float)(samples - 1));
+    const V zero_v(0.0f);
+    const V one_v(1.0f);
+    const V center_v((float)center);
+    const V step_x_v(step_x);
+    const V step_y_v(scale_y / samples);
+    const V offset_x_v(offset_x);
+    const V offset_y_v(offset_y);
+    const V x_center_v = mul_add(center_v, step_x_v, offset_x_v);
+
+    const auto hit = [&](const V cx_v, const V y_v) { return draw_mask<V, shape>(mul_add(cx_v, step_x_v, offset_x_v), y_v); };
+
+    long long count = 0;
+    float spans[group_size];
+
+    for (int cy = 0; cy < samples; cy += group_size)
+    {
+        const V cy_v = ci_v + V((float)cy);
+        const V y_v = mul_add(cy_v, step_y_v, offset_y_v);
+
+        const auto row_v = draw_mask<V, shape>(x_center_v, y_v) && (cy_v < samples_v);
+
+        if (!horizontal_or(row_v))
+            continue;
+
+        const V r_v = sqrt(max(shape_span<shape>::half_width_sq(y_v), zero_v));
+
+        V hi_v = min(max(floor((r_v - offset_x_v) / step_x_v), center_v), last_v);
+        V lo_v = min(max(ceil((zero_v - r_v - offset_x_v) / step_x_v), zero_v), center_v);
+
+        for (;;)
+        {
+            const auto step = row_v && (hi_v < last_v) && hit(hi_v + one_v, y_v);
+            if (!horizontal_or(step))
+                break;
+            hi_v = select(step, hi_v + one_v, hi_v);
+        }
+        for (;;)
+        {
+            const auto step = row_v && !hit(hi_v, y_v);
+            if (!horizontal_or(step))
+                break;
+            hi_v = select(step, hi_v - one_v, hi_v);
+        }
+
+        for (;;)
+        {
+            const auto step = row_v && (lo_v > zero_v) && hit(lo_v - one_v, y_v);
+            if (!horizontal_or(step))
+                break;
+            lo_v = select(step, lo_v - one_v, lo_v);
+        }
+        for (;;)
+        {
+            const auto step = row_v && !hit(lo_v, y_v);
+            if (!horizontal_or(step))
+                break;
+            lo_v = select(step, lo_v + one_v, lo_v);
+        }
+
+        // Runs are summed as integers, a float sum of several rows could round
+        select(row_v, hi_v - lo_v + one_v, zero_v).store(spans);
+
+        for (int i = 0; i < group_size; i++)
+        {
+            count += (long long)spans[i];
+        }
+    }
+
+    return (float)((double)count / ((long long)samples * samples));
+}
+
+// Shapes without spans fall back to the row sweep
+template <vectorization_level vl, graph_shape shape> constexpr float calc_avg_span(const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    if constexpr (!shape_span<shape>::enabled)
+    {
+        return calc_avg_rows<vl, shape>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::NONE)
+    {
+        return calc_avg_span_s<shape>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::SSE4)
+    {
+        return calc_avg_span_v<Vec4f, shape>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX2)
+    {
+        return calc_avg_span_v<Vec8f, shape>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX512)
+    {
+        return calc_avg_span_v<Vec16f, shape>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+}
+
+// Lane helpers so the shape program interpreter and the precise kernels also run on plain scalars
+template <typename V> constexpr int lane_count()
+{
+    if constexpr (std::is_arithmetic_v<V>)
+        return 1;
+    else
+        return V::size();
+}
+
+inline float lane_mul_add(const float a, const float b, const float c) { return std::fma(a, b, c); }
+inline double lane_mul_add(const double a, const double b, const double c) { return std::fma(a, b, c); }
+template <typename V> V lane_mul_add(const V a, const V b, const V c) { return mul_add(a, b, c); }
+
+inline float lane_abs(const float a) { return std::abs(a); }
+template <typename V> V lane_abs(const V a) { return abs(a); }
+
+inline int lane_count_true(const bool m) { return m; }
+template <typename M> int lane_count_true(const M m) { return horizontal_count(m); }
+
+// Lattice coordinates of the integer lattice kernel stay below 2^30 in magnitude, so squares and
+// their differences fit 64 bit lanes
+constexpr double lattice_max_coordinate = 1073741824.0;
+
+// The lattice needs square samples and a view that keeps its coordinates in range
+inline bool lattice_supported(const int samples, const float scale_x, const float scale_y, const float offset_x, const float offset_y)
+{
+    const double h = (double)scale_x / samples;
+    const double extent = std::max({ std::abs((double)offset_x), std::abs((double)offset_x + scale_x),
+        std::abs((double)offset_y), std::abs((double)offset_y + scale_y), 1.0 });
+
+    return scale_x == scale_y && h > 0.0 && extent / h + samples < lattice_max_coordinate;
+}
+
+// Lattice of a unit: the threshold t of the unit circle in squared steps and the unit origin
+// snapped to the lattice
+struct lattice_origin
+{
+    long long t;
+    long long i0;
+    long long j0;
+};
+
+inline lattice_origin lattice_frame(const int samples, const float scale_x, const float offset_x, const float offset_y)
+{
+    const double h = (double)scale_x / samples;
+
+    return { (long long)std::ceil(1.0 / (h * h)), std::llround(offset_x / h), std::llround(offset_y / h) };
+}
+
+// Fixed point row sweep on an integer lattice: the unit origin is snapped to the nearest multiple of
+// the sample step h, and each sample is the integer pair (i, j) of its coordinate in steps. Along a
+// row e(i) = i^2 + row_term(j^2) - t is stepped by exact integer differences, so the inner loop only
+// adds and compares 64 bit lanes, Q being one of them or a vector of them. Counts are the same on
+// every instruction set and compiler. Callers check lattice_supported, so scale_y equals scale_x.
+template <typename Q, graph_shape shape> const float calc_avg_lattice_v(const int samples, const float scale_x, const float,
+    const float offset_x, const float offset_y)
+{
+    static constexpr int group_size = lane_count<Q>();
+
+    const int block_end = samples - samples % group_size;
+
+    const lattice_origin frame = lattice_frame(samples, scale_x, offset_x, offset_y);
+    const long long t = frame.t;
+    const long long i0 = frame.i0;
+    const long long j0 = frame.j0;
+
+    // e(i) of each lane's first column without the row part, and its step to the lane's next column
+    Q lane_e_v;
+    Q lane_d_v;
+
+    if constexpr (group_size == 1)
+    {
+        lane_e_v = i0 * i0;
+        lane_d_v = 2 * i0 + 1;
+    }
+    else
+    {
+        for (int l = 0; l < group_size; l++)
+        {
+            const long long i = i0 + l;
+
+            lane_e_v.insert(l, i * i);
+            lane_d_v.insert(l, 2 * group_size * i + group_size * group_size);
+        }
+    }
+
+    const Q dd_v(2LL * group_size * group_size);
+
+    long long count = 0;
+    Q count_v(0);
+
+    for (int cy = 0; cy < samples; cy++)
+    {
+        const long long j = j0 + cy;
+
+        if (!shape_lattice<shape>::row_hit(j * j, t))
+            continue;
+
+        const long long base = shape_lattice<shape>::row_term(j * j) - t;
+
+        Q e_v = lane_e_v + Q(base);
+        Q d_v = lane_d_v;
+
+        for (int cx = 0; cx < block_end; cx += group_size)
+        {
+            if constexpr (group_size == 1)
+                count_v += e_v < 0;
+            else
+                count_v = if_add(e_v < Q(0), count_v, Q(1));
+
+            e_v += d_v;
+            d_v += dd_v;
+        }
+
+        for (int cx = block_end; cx < samples; cx++)
+        {
+            const long long i = i0 + cx;
+
+            count += i * i + base < 0;
+        }
+    }
+
+    if constexpr (group_size == 1)
+        count += count_v;
+    else
+        count += horizontal_add(count_v);
+
+    return (float)((double)count / ((long long)samples * samples));
+}
+
+// Shapes without a lattice form, non-square units and views beyond the lattice range fall back to
+// the row sweep
+template <vectorization_level vl, graph_shape shape> float calc_avg_lattice(const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    if constexpr (shape_lattice<shape>::enabled)
+    {
+        if (lattice_supported(samples, scale_x, scale_y, offset_x, offset_y))
+        {
+            if constexpr (vl == vectorization_level::NONE)
+                return calc_avg_lattice_v<long long, shape>(samples, scale_x, scale_y, offset_x, offset_y);
+            else if constexpr (vl == vectorization_level::SSE4)
+                return calc_avg_lattice_v<Vec2q, shape>(samples, scale_x, scale_y, offset_x, offset_y);
+            else if constexpr (vl == vectorization_level::AVX2)
+                return calc_avg_lattice_v<Vec4q, shape>(samples, scale_x, scale_y, offset_x, offset_y);
+            else
+                return calc_avg_lattice_v<Vec8q, shape>(samples, scale_x, scale_y, offset_x, offset_y);
+        }
+    }
+
+    return calc_avg_rows<vl, shape>(samples, scale_x, scale_y, offset_x, offset_y);
+}
+
+// Hits of the lattice columns [i_begin, i_end) in rows [j_begin, j_end), one sample at a time
+template <graph_shape shape> long long lattice_hits(const long long i_begin, const long long i_end, const long long j_begin,
+    const long long j_end, const long long t)
+{
+    long long count = 0;
+
+    for (long long j = j_begin; j < j_end; j++)
+    {
+        if (!shape_lattice<shape>::row_hit(j * j, t))
+            continue;
+
+        const long long base = shape_lattice<shape>::row_term(j * j) - t;
+
+        for (long long i = i_begin; i < i_end; i++)
+            count += i * i + base < 0;
+    }
+
+    return count;
+}
+
+// Image units of a centered view lie a step or two off their representative on the lattice, ones
+// further off are computed
+constexpr long long lattice_mirror_max_shift = 2;
+
+// The shape is symmetric in lattice coordinates, so an image unit hits as often as its samples
+// mapped back by the inverse transform, a square of samples usually one step off the
+// representative's. The count differs by the columns and rows of the two squares that do not
+// overlap, O(samples) lattice points instead of samples^2.
+template <graph_shape shape> bool lattice_mirror_delta(const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y, const float image_offset_x, const float image_offset_y,
+    const unit_transform transform, long long& delta)
+{
+    if (samples > lattice_mirror_max_samples || !lattice_supported(samples, scale_x, scale_y, offset_x, offset_y)
+        || !lattice_supported(samples, scale_x, scale_y, image_offset_x, image_offset_y))
+        return false;
+
+    const long long s = samples;
+    const lattice_origin unit = lattice_frame(samples, scale_x, offset_x, offset_y);
+    const lattice_origin image = lattice_frame(samples, scale_x, image_offset_x, image_offset_y);
+
+    // Mirrored first, then swapped back
+    long long x = transform.flip_x ? -(image.i0 + s - 1) : image.i0;
+    long long y = transform.flip_y ? -(image.j0 + s - 1) : image.j0;
+
+    if (transform.swap)
+        std::swap(x, y);
+
+    const long long x0 = unit.i0;
+    const long long y0 = unit.j0;
+    const long long t = unit.t;
+
+    if (std::abs(x - x0) + std::abs(y - y0) > lattice_mirror_max_shift)
+        return false;
+
+    delta = 0;
+
+    // Columns gained and lost over the image's rows, then rows gained and lost over the unit's columns
+    if (x > x0)
+        delta += lattice_hits<shape>(x0 + s, x + s, y, y + s, t) - lattice_hits<shape>(x0, x, y, y + s, t);
+    else if (x < x0)
+        delta += lattice_hits<shape>(x, x0, y, y + s, t) - lattice_hits<shape>(x + s, x0 + s, y, y + s, t);
+
+    if (y > y0)
+        delta += lattice_hits<shape>(x0, x0 + s, y0 + s, y + s, t) - lattice_hits<shape>(x0, x0 + s, y0, y, t);
+    else if (y < y0)
+        delta += lattice_hits<shape>(x0, x0 + s, y, y0, t) - lattice_hits<shape>(x0, x0 + s, y + s, y0 + s, t);
+
+    return true;
+}
+
+template <graph_shape shape> constexpr lattice_mirror_func select_lattice_mirror_delta()
+{
+    if constexpr (shape_lattice<shape>::enabled)
+        return lattice_mirror_delta<shape>;
+    else
+        return nullptr;
+}
+
+// Column indices 0, 1, ... of a vector's lanes
+template <typename V, typename S> V lane_indices()
+{
+    if constexpr (lane_count<V>() == 1)
+    {
+        return V(0);
+    }
+    else
+    {
+        V ci_v;
+        for (int i = 0; i < lane_count<V>(); i++)
+        {
+            ci_v.insert(i, (S)i);
+        }
+        return ci_v;
+    }
+}
+
+// Row sweep like calc_avg_rows_v over any scalar or vector type V, counting the lanes where
+// predicate(x_v, y_v) holds. The unit rectangle is rounded to V's precision.
+template <typename V, int accumulators, typename P> float sweep_rows(const int samples, const double scale_x, const double scale_y,
+    const double offset_x, const double offset_y, const P& predicate)
+{
+    typedef decltype(V() < V()) M;
+
+    static constexpr int group_size = lane_count<V>();
+    static constexpr int block_size = group_size * accumulators;
+
+    const int block_end = samples - samples % block_size;
+
+    const V ci_v = lane_indices<V, double>();
+    const V samples_v((double)samples);
+    const V step_x_v(scale_x / samples);
+    const V step_y_v(scale_y / samples);
+    const V offset_x_v(offset_x);
+    const V offset_y_v(offset_y);
+
+    long long count[accumulators] = {};
+
+    for (int cy = 0; cy < samples; cy++)
+    {
+        const V y_v = lane_mul_add(V((double)cy), step_y_v, offset_y_v);
+
+        V cx_v = ci_v;
+
+        for (int cx = 0; cx < block_end; cx += block_size)
+        {
+            for (int a = 0; a < accumulators; a++)
+            {
+                const V x_v = lane_mul_add(cx_v + V((double)(a * group_size)), step_x_v, offset_x_v);
+
+                count[a] += lane_count_true(predicate(x_v, y_v));
+            }
+
+            cx_v += V((double)block_size);
+        }
+
+        for (int cx = block_end; cx < samples; cx += group_size)
+        {
+            const V x_v = lane_mul_add(cx_v, step_x_v, offset_x_v);
+
+            count[0] += lane_count_true(M(predicate(x_v, y_v) && (cx_v < samples_v)));
+
+            cx_v += V((double)group_size);
+        }
+    }
+
+    long long sum = 0;
+    for (int a = 0; a < accumulators; a++)
+    {
+        sum += count[a];
+    }
+
+    return (float)((double)sum / ((long long)samples * samples));
+}
+
+// Row sweep with every coordinate in double, for zooms where float sample coordinates collapse.
+// V is double or a double vector, at half the lanes of the float kernels.
+template <typename V, graph_shape shape, int accumulators> float calc_avg_rows_double(const int samples, const double scale_x, const double scale_y,
+    const double offset_x, const double offset_y)
+{
+    return sweep_rows<V, accumulators>(samples, scale_x, scale_y, offset_x, offset_y,
+        [](const V x_v, const V y_v) { return draw_mask<V, shape>(x_v, y_v); });
+}
+
+// Escape-time shape with a runtime iteration limit. Vectors iterate until all of their lanes have
+// escaped, so the cost of a unit follows the slowest sample of each vector.
+template <typename V, graph_shape shape> float calc_avg_escape_v(const int max_iterations, const int samples, const double scale_x, const double scale_y,
+    const double offset_x, const double offset_y)
+{
+    return sweep_rows<V, row_sweep_accumulators>(samples, scale_x, scale_y, offset_x, offset_y,
+        [max_iterations](const V x_v, const V y_v) { return escape_mask<V, shape>(x_v, y_v, max_iterations); });
+}
+
+// Single precision on float vectors, double on double vectors. Mixed precision has no expansion for
+// orbits and runs the single precision kernel.
+template <vectorization_level vl, precision_mode precision, graph_shape shape> float calc_avg_escape(const int max_iterations, const int samples,
+    const double scale_x, const double scale_y, const double offset_x, const double offset_y)
+{
+    constexpr bool wide = precision == precision_mode::DOUBLE;
+
+    if constexpr (vl == vectorization_level::NONE)
+    {
+        typedef std::conditional_t<wide, double, float> V;
+        return calc_avg_escape_v<V, shape>(max_iterations, samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::SSE4)
+    {
+        typedef std::conditional_t<wide, Vec2d, Vec4f> V;
+        return calc_avg_escape_v<V, shape>(max_iterations, samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX2)
+    {
+        typedef std::conditional_t<wide, Vec4d, Vec8f> V;
+        return calc_avg_escape_v<V, shape>(max_iterations, samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX512)
+    {
+        typedef std::conditional_t<wide, Vec8d, Vec16f> V;
+        return calc_avg_escape_v<V, shape>(max_iterations, samples, scale_x, scale_y, offset_x, offset_y);
+    }
+}
+
+// Row sweep on offset_coord: the unit origin stays in double, sample offsets from it are float
+// vectors of the same width as the single precision kernels
+template <typename V, graph_shape shape, int accumulators> float calc_avg_rows_mixed(const int samples, const double scale_x, const double scale_y,
+    const double offset_x, const double offset_y)
+{
+    typedef decltype(V() < V()) M;
+    typedef offset_coord<V> C;
+
+    static constexpr int group_size = lane_count<V>();
+    static constexpr int block_size = group_size * accumulators;
+
+    const int block_end = samples - samples % block_size;
+
+    const V ci_v = lane_indices<V, float>();
+    const V samples_v((float)samples);
+    const V step_x_v((float)(scale_x / samples));
+    const V step_y_v((float)(scale_y / samples));
+
+    long long count[accumulators] = {};
+
+    for (int cy = 0; cy < samples; cy++)
+    {
+        const C y_c(offset_y, V((float)cy) * step_y_v);
+
+        V cx_v = ci_v;
+
+        for (int cx = 0; cx < block_end; cx += block_size)
+        {
+            for (int a = 0; a < accumulators; a++)
+            {
+                const C x_c(offset_x, (cx_v + V((float)(a * group_size))) * step_x_v);
+
+                count[a] += lane_count_true(draw_mask<C, shape>(x_c, y_c));
+            }
+
+            cx_v += V((float)block_size);
+        }
+
+        for (int cx = block_end; cx < samples; cx += group_size)
+        {
+            const C x_c(offset_x, cx_v * step_x_v);
+
+            count[0] += lane_count_true(M(draw_mask<C, shape>(x_c, y_c) && (cx_v < samples_v)));
+
+            cx_v += V((float)group_size);
+        }
+    }
+
+    long long sum = 0;
+    for (int a = 0; a < accumulators; a++)
+    {
+        sum += count[a];
+    }
+
+    return (float)((double)sum / ((long long)samples * samples));
+}
+
+template <vectorization_level vl, graph_shape shape> float calc_avg_double(const int samples, const double scale_x, const double scale_y,
+    const double offset_x, const double offset_y)
+{
+    if constexpr (vl == vectorization_level::NONE)
+    {
+        return calc_avg_rows_double<double, shape, row_sweep_accumulators>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::SSE4)
+    {
+        return calc_avg_rows_double<Vec2d, shape, row_sweep_accumulators>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX2)
+    {
+        return calc_avg_rows_double<Vec4d, shape, row_sweep_accumulators>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX512)
+    {
+        return calc_avg_rows_double<Vec8d, shape, row_sweep_accumulators>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+}
+
+template <vectorization_level vl, graph_shape shape> float calc_avg_mixed(const int samples, const double scale_x, const double scale_y,
+    const double offset_x, const double offset_y)
+{
+    if constexpr (vl == vectorization_level::NONE)
+    {
+        return calc_avg_rows_mixed<float, shape, row_sweep_accumulators>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::SSE4)
+    {
+        return calc_avg_rows_mixed<Vec4f, shape, row_sweep_accumulators>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX2)
+    {
+        return calc_avg_rows_mixed<Vec8f, shape, row_sweep_accumulators>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX512)
+    {
+        return calc_avg_rows_mixed<Vec16f, shape, row_sweep_accumulators>(samples, scale_x, scale_y, offset_x, offset_y);
+    }
+}
+
+// Adds the hits of every shape in set (bit 1 << shape) at one vector of samples. Tail vectors also
+// mask the lanes past the last column.
+template <typename V, bool tail, typename M, int... shapes> void count_batch(const unsigned set, const V x_v, const V y_v, const M valid,
+    long long* count, std::integer_sequence<int, shapes...>)
+{
+    ((void)((set >> shapes & 1) != 0 && (count[shapes] += tail
+        ? lane_count_true(M(draw_mask<V, (graph_shape)shapes>(x_v, y_v) && valid))
+        : lane_count_true(draw_mask<V, (graph_shape)shapes>(x_v, y_v)), true)), ...);
+}
+
+// Row sweep of several shapes over the same samples: each vector of coordinates is generated once
+// and every shape in set is evaluated on it, avg[shape] receives the shape's coverage. Coordinates
+// are those of calc_avg_rows_v, so each shape counts the same hits as its own row sweep.
+template <typename V> void calc_avg_batch_v(const unsigned set, const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y, float* avg)
+{
+    typedef decltype(V() < V()) M;
+
+    static constexpr int group_size = lane_count<V>();
+
+    const int block_end = samples - samples % group_size;
+    const auto shapes = std::make_integer_sequence<int, batch_shape_count>();
+
+    const V ci_v = lane_indices<V, float>();
+    const V samples_v((float)samples);
+    const V step_x_v(scale_x / samples);
+    const V step_y_v(scale_y / samples);
+    const V offset_x_v(offset_x);
+    const V offset_y_v(offset_y);
+
+    long long count[batch_shape_count] = {};
+
+    for (int cy = 0; cy < samples; cy++)
+    {
+        const V y_v = lane_mul_add(V((float)cy), step_y_v, offset_y_v);
+
+        V cx_v = ci_v;
+
+        for (int cx = 0; cx < block_end; cx += group_size)
+        {
+            count_batch<V, false>(set, lane_mul_add(cx_v, step_x_v, offset_x_v), y_v, M(true), count, shapes);
+
+            cx_v += V((float)group_size);
+        }
+
+        if (block_end < samples)
+            count_batch<V, true>(set, lane_mul_add(cx_v, step_x_v, offset_x_v), y_v, M(cx_v < samples_v), count, shapes);
+    }
+
+    for (int s = 0; s < batch_shape_count; s++)
+    {
+        if (set >> s & 1)
+            avg[s] = (float)((double)count[s] / ((long long)samples * samples));
+    }
+}
+
+template <vectorization_level vl> void calc_avg_batch(const unsigned set, const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y, float* avg)
+{
+    if constexpr (vl == vectorization_level::NONE)
+    {
+        calc_avg_batch_v<float>(set, samples, scale_x, scale_y, offset_x, offset_y, avg);
+    }
+    else if constexpr (vl == vectorization_level::SSE4)
+    {
+        calc_avg_batch_v<Vec4f>(set, samples, scale_x, scale_y, offset_x, offset_y, avg);
+    }
+    else if constexpr (vl == vectorization_level::AVX2)
+    {
+        calc_avg_batch_v<Vec8f>(set, samples, scale_x, scale_y, offset_x, offset_y, avg);
+    }
+    else if constexpr (vl == vectorization_level::AVX512)
+    {
+        calc_avg_batch_v<Vec16f>(set, samples, scale_x, scale_y, offset_x, offset_y, avg);
+    }
+}
+
+// Vectors evaluated per instruction by the shape program interpreter
+constexpr int program_block = 8;
+
+// Row sweep like calc_avg_rows_v, with the predicate read from a shape program. Each instruction
+// is applied to program_block vectors at once so the dispatch cost is shared across many lanes.
+template <typename V> float calc_avg_program_v(const shape_program& program, const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    typedef decltype(V() < V()) M;
+
+    static constexpr int group_size = lane_count<V>();
+    static constexpr int chunk_size = group_size * program_block;
+
+    V ci_v;
+    if constexpr (group_size == 1)
+    {
+        ci_v = 0.0f;
+    }
+    else
+    {
+        for (int i = 0; i < group_size; i++)
+        {
+            ci_v.insert(i, (float)i);
+        }
+    }
+
+    const V samples_v((float)samples);
+    const V step_x_v(scale_x / samples);
+    const V step_y_v(scale_y / samples);
+    const V offset_x_v(offset_x);
+    const V offset_y_v(offset_y);
+
+    V values[shape_max_registers][program_block];
+    M masks[shape_max_registers][program_block];
+
+    const shape_instr* const code = program.code.data();
+    const int code_size = (int)program.code.size();
+
+    long long count = 0;
+
+    for (int cy = 0; cy < samples; cy++)
+    {
+        const V y_v = lane_mul_add(V((float)cy), step_y_v, offset_y_v);
+
+        for (int cx = 0; cx < samples; cx += chunk_size)
+        {
+            for (int k = 0; k < program_block; k++)
+            {
+                values[0][k] = lane_mul_add(V((float)(cx + k * group_size)) + ci_v, step_x_v, offset_x_v);
+                values[1][k] = y_v;
+            }
+
+            for (int pc = 0; pc < code_size; pc++)
+            {
+                const shape_instr in = code[pc];
+
+                V* const d = values[in.dst];
+                const V* const a = values[in.a];
+                const V* const b = values[in.b];
+
+                switch (in.op)
+                {
+                case shape_op::CONST:
+                    for (int k = 0; k < program_block; k++) d[k] = V(in.value);
+                    break;
+                case shape_op::ADD:
+                    for (int k = 0; k < program_block; k++) d[k] = a[k] + b[k];
+                    break;
+                case shape_op::SUB:
+                    for (int k = 0; k < program_block; k++) d[k] = a[k] - b[k];
+                    break;
+                case shape_op::MUL:
+                    for (int k = 0; k < program_block; k++) d[k] = a[k] * b[k];
+                    break;
+                case shape_op::DIV:
+                    for (int k = 0; k < program_block; k++) d[k] = a[k] / b[k];
+                    break;
+                case shape_op::NEG:
+                    for (int k = 0; k < program_block; k++) d[k] = -a[k];
+                    break;
+                case shape_op::ABS:
+                    for (int k = 0; k < program_block; k++) d[k] = lane_abs(a[k]);
+                    break;
+                case shape_op::LT:
+                    for (int k = 0; k < program_block; k++) masks[in.dst][k] = a[k] < b[k];
+                    break;
+                case shape_op::LE:
+                    for (int k = 0; k < program_block; k++) masks[in.dst][k] = a[k] <= b[k];
+                    break;
+                case shape_op::AND:
+                    for (int k = 0; k < program_block; k++) masks[in.dst][k] = masks[in.a][k] && masks[in.b][k];
+                    break;
+                case shape_op::OR:
+                    for (int k = 0; k < program_block; k++) masks[in.dst][k] = masks[in.a][k] || masks[in.b][k];
+                    break;
+                case shape_op::NOT:
+                    for (int k = 0; k < program_block; k++) masks[in.dst][k] = !masks[in.a][k];
+                    break;
+                }
+            }
+
+            const M* const result = masks[program.result];
+
+            if (cx + chunk_size <= samples)
+            {
+                for (int k = 0; k < program_block; k++)
+                {
+                    count += lane_count_true(result[k]);
+                }
+            }
+            else
+            {
+                for (int k = 0; k < program_block; k++)
+                {
+                    const V cx_v = V((float)(cx + k * group_size)) + ci_v;
+                    count += lane_count_true(M(result[k] && (cx_v < samples_v)));
+                }
+            }
+        }
+    }
+
+    return (float)((double)count / ((long long)samples * samples));
+}
+
+template <vectorization_level vl> float calc_avg_program(const shape_program& program, const int samples, const float scale_x, const float scale_y,
+    const float offset_x, const float offset_y)
+{
+    if constexpr (vl == vectorization_level::NONE)
+    {
+        return calc_avg_program_v<float>(program, samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::SSE4)
+    {
+        return calc_avg_program_v<Vec4f>(program, samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX2)
+    {
+        return calc_avg_program_v<Vec8f>(program, samples, scale_x, scale_y, offset_x, offset_y);
+    }
+    else if constexpr (vl == vectorization_level::AVX512)
+    {
+        return calc_avg_program_v<Vec16f>(program, samples, scale_x, scale_y, offset_x, offset_y);
+    }
+}
+
+// Sums of stored graph values, integer formats are summed exactly. Float lanes are summed in blocks
+// added to a double total, so long graphs do not lose small values to a large float sum.
+template <typename V> double coverage_sum_float(const float* data, const long long count)
+{
+    constexpr int n = V::size();
+    constexpr long long block = 1024LL * n;
+
+    const long long vector_end = count - count % n;
+    double total = 0.0;
+
+    for (long long begin = 0; begin < vector_end; begin += block)
+    {
+        const long long end = std::min(begin + block, vector_end);
+        V sum(0.0f);
+
+        for (long long i = begin; i < end; i += n)
+            sum += V().load(data + i);
+
+        total += horizontal_add(sum);
+    }
+
+    for (long long i = vector_end; i < count; i++)
+        total += data[i];
+
+    return total;
+}
+
+// 16 bit values are widened to 32 bit lanes, which gain at most 2 * 65535 per vector. Blocks of
+// 1024 vectors keep the horizontal sum of 16 lanes below 2^32.
+template <typename V16, typename V32> double coverage_sum_u16(const uint16_t* data, const long long count)
+{
+    constexpr int n = V16::size();
+    constexpr long long block = 1024LL * n;
+
+    const long long vector_end = count - count % n;
+    double total = 0.0;
+
+    for (long long begin = 0; begin < vector_end; begin += block)
+    {
+        const long long end = std::min(begin + block, vector_end);
+        V32 sum(0);
+
+        for (long long i = begin; i < end; i += n)
+        {
+            const V16 v = V16().load(data + i);
+            sum += extend_low(v) + extend_high(v);
+        }
+
+        total += horizontal_add(sum);
+    }
+
+    for (long long i = vector_end; i < count; i++)
+        total += data[i];
+
+    return total;
+}
+
+// 8 bit values are summed in 16 bit lanes, which gain at most 2 * 255 per vector, and widened to
+// 32 bit every 128 vectors
+template <typename V8, typename V16, typename V32> double coverage_sum_u8(const uint8_t* data, const long long count)
+{
+    constexpr int n = V8::size();
+    constexpr long long block = 128LL * n;
+
+    const long long vector_end = count - count % n;
+    double total = 0.0;
+
+    for (long long begin = 0; begin < vector_end; begin += block)
+    {
+        const long long end = std::min(begin + block, vector_end);
+        V16 sum(0);
+
+        for (long long i = begin; i < end; i += n)
+        {
+            const V8 v = V8().load(data + i);
+            sum += extend_low(v) + extend_high(v);
+        }
+
+        total += horizontal_add(extend_low(sum) + extend_high(sum));
+    }
+
+    for (long long i = vector_end; i < count; i++)
+        total += data[i];
+
+    return total;
+}
+
+template <typename T> double coverage_sum_s(const T* data, const long long count)
+{
+    double total = 0.0;
+
+    for (long long i = 0; i < count; i++)
+        total += data[i];
+
+    return total;
+}
+
+template <vectorization_level vl, coverage_format format> double coverage_sum(const void* data, const long long count)
+{
+    if constexpr (format == coverage_format::FLOAT32)
+    {
+        const float* values = (const float*)data;
+
+        if constexpr (vl == vectorization_level::NONE)
+            return coverage_sum_s(values, count);
+        else if constexpr (vl == vectorization_level::SSE4)
+            return coverage_sum_float<Vec4f>(values, count);
+        else if constexpr (vl == vectorization_level::AVX2)
+            return coverage_sum_float<Vec8f>(values, count);
+        else
+            return coverage_sum_float<Vec16f>(values, count);
+    }
+    else if constexpr (format == coverage_format::UINT16)
+    {
+        const uint16_t* values = (const uint16_t*)data;
+
+        if constexpr (vl == vectorization_level::NONE)
+            return coverage_sum_s(values, count);
+        else if constexpr (vl == vectorization_level::SSE4)
+            return coverage_sum_u16<Vec8us, Vec4ui>(values, count);
+        else if constexpr (vl == vectorization_level::AVX2)
+            return coverage_sum_u16<Vec16us, Vec8ui>(values, count);
+        else
+            return coverage_sum_u16<Vec32us, Vec16ui>(values, count);
+    }
+    else
+    {
+        const uint8_t* values = (const uint8_t*)data;
+
+        if constexpr (vl == vectorization_level::NONE)
+            return coverage_sum_s(values, count);
+        else if constexpr (vl == vectorization_level::SSE4)
+            return coverage_sum_u8<Vec16uc, Vec8us, Vec4ui>(values, count);
+        else if constexpr (vl == vectorization_level::AVX2)
+            return coverage_sum_u8<Vec32uc, Vec16us, Vec8ui>(values, count);
+        else
+            return coverage_sum_u8<Vec64uc, Vec32us, Vec16ui>(values, count);
+    }
+}
+
+template <vectorization_level vl, int... shapes> void fill_kernel_table(kernel_table& table, std::integer_sequence<int, shapes...>)
+{
+    ((table.calc_avg[(int)sampling_kernel::FLAT_INDEX][shapes] = calc_avg<vl, (graph_shape)shapes>), ...);
+    ((table.calc_avg[(int)sampling_kernel::ROW_SWEEP][shapes] = calc_avg_rows<vl, (graph_shape)shapes>), ...);
+    ((table.calc_avg[(int)sampling_kernel::SPAN][shapes] = calc_avg_span<vl, (graph_shape)shapes>), ...);
+    ((table.calc_avg[(int)sampling_kernel::LATTICE][shapes] = calc_avg_lattice<vl, (graph_shape)shapes>), ...);
+    ((table.classify[shapes] = classify_unit<(graph_shape)shapes>), ...);
+    ((table.calc_avg_double[shapes] = calc_avg_double<vl, (graph_shape)shapes>), ...);
+    ((table.calc_avg_mixed[shapes] = calc_avg_mixed<vl, (graph_shape)shapes>), ...);
+    ((table.symmetry[shapes] = shape_symmetry<(graph_shape)shapes>), ...);
+    ((table.span[shapes] = shape_span<(graph_shape)shapes>::enabled), ...);
+    ((table.lattice[shapes] = shape_lattice<(graph_shape)shapes>::enabled), ...);
+    ((table.lattice_mirror[shapes] = select_lattice_mirror_delta<(graph_shape)shapes>()), ...);
+}
+
+template <vectorization_level vl, int variant, int... shapes> void fill_row_variants(kernel_table& table, std::integer_sequence<int, shapes...>)
+{
+    ((table.calc_avg_rows_variant[variant][shapes] = calc_avg_rows<vl, (graph_shape)shapes, row_sweep_variant_accumulators[variant]>), ...);
+}
+
+template <vectorization_level vl, precision_mode precision> void fill_escape_table(kernel_table& table)
+{
+    table.calc_escape[(int)precision][escape_shape_index(graph_shape::MANDELBROT)] = calc_avg_escape<vl, precision, graph_shape::MANDELBROT>;
+    table.calc_escape[(int)precision][escape_shape_index(graph_shape::JULIA)] = calc_avg_escape<vl, precision, graph_shape::JULIA>;
+}
+
+template <vectorization_level vl> const kernel_table make_kernel_table()
+{
+    kernel_table table;
+    table.vec_level = vl;
+
+    fill_kernel_table<vl>(table, std::make_integer_sequence<int, graph_shape_count>());
+
+    fill_row_variants<vl, 0>(table, std::make_integer_sequence<int, graph_shape_count>());
+    fill_row_variants<vl, 1>(table, std::make_integer_sequence<int, graph_shape_count>());
+    fill_row_variants<vl, 2>(table, std::make_integer_sequence<int, graph_shape_count>());
+    fill_row_variants<vl, 3>(table, std::make_integer_sequence<int, graph_shape_count>());
+
+    table.calc_program = calc_avg_program<vl>;
+    table.calc_batch = calc_avg_batch<vl>;
+
+    fill_escape_table<vl, precision_mode::SINGLE>(table);
+    fill_escape_table<vl, precision_mode::DOUBLE>(table);
+    fill_escape_table<vl, precision_mode::MIXED>(table);
+
+    table.coverage_sum[(int)coverage_format::FLOAT32] = coverage_sum<vl, coverage_format::FLOAT32>;
+    table.coverage_sum[(int)coverage_format::UINT16] = coverage_sum<vl, coverage_format::UINT16>;
+    table.coverage_sum[(int)coverage_format::UINT8] = coverage_sum<vl, coverage_format::UINT8>;
+
+    return table;
+}
+
+#ifdef VCL_NAMESPACE
+}
+#endif
@@ -1,29 +1,30 @@
 #pragma once
 
-#include <vectorclass.h>
 #include <string>
 #include <vector>
 
-const Vec8f one_v(1);
-const Vec8f none_v(-1);
-const Vec8f zero_v(0);
-
-const Vec8f ci_v8(0, 1, 2, 3, 4, 5, 6, 7);
-
 enum class vectorization_level
 {
     NONE,
-    AVX2
+    SSE4,
+    AVX2,
+    AVX512
 };
 
+constexpr int vec_level_count = 4;
+
 inline std::string vec_level_to_string(vectorization_level obj)
 {
     switch (obj)
     {
     case vectorization_level::NONE:
         return "No defined vectorization";
+    case vectorization_level::SSE4:
+        return "SSE4.1 (128 bit)";
     case vectorization_level::AVX2:
         return "AVX2 (256 bit)";
+    case vectorization_level::AVX512:
+        return "AVX-512 (512 bit)";
     }
 }
 
@@ -32,9 +33,75 @@ enum class graph_shape
     EMPTY,
     CIRCLE,
     HYPERBOLA,
-    SQUARE
+    SQUARE,
+    CIRCLE_MINUS_SQUARE,
+    HYPERBOLA_INTERSECTION,
+    MANDELBROT,
+    JULIA
 };
 
+constexpr int graph_shape_count = 8;
+
+// Escape-time shapes iterate z = z^2 + c per sample, so their cost varies across the graph
+constexpr bool is_escape_shape(graph_shape shape)
+{
+    return shape == graph_shape::MANDELBROT || shape == graph_shape::JULIA;
+}
+
+constexpr int escape_shape_count = 2;
+
+constexpr int escape_shape_index(graph_shape shape)
+{
+    return (int)shape - (int)graph_shape::MANDELBROT;
+}
+
+// Shapes that can be evaluated together in one batch, every shape before the escape-time shapes.
+// Batches are sets of shapes with bit 1 << shape.
+constexpr int batch_shape_count = (int)graph_shape::MANDELBROT;
+
+// Iteration limit of escape-time shapes unless a run sets its own
+constexpr int escape_default_iterations = 256;
+
+// Symmetries of a shape's region: the mirrors x -> -x and y -> -y, the diagonal x <-> y and the
+// point symmetry (x, y) -> (-x, -y), which also follows from both mirrors
+struct symmetry_group
+{
+    bool mirror_x = false;
+    bool mirror_y = false;
+    bool diagonal = false;
+    bool point = false;
+
+    bool any() const
+    {
+        return mirror_x || mirror_y || diagonal || point;
+    }
+};
+
+// Map of a unit grid onto itself: (x, y) -> (y, x) when swap, then mirrored across the axes that
+// are set
+struct unit_transform
+{
+    bool swap = false;
+    bool flip_x = false;
+    bool flip_y = false;
+};
+
+inline std::string symmetry_group_to_string(const symmetry_group& obj)
+{
+    std::string s;
+
+    if (obj.mirror_x)
+        s += "x mirror";
+    if (obj.mirror_y)
+        s += s.empty() ? "y mirror" : ", y mirror";
+    if (obj.diagonal)
+        s += s.empty() ? "diagonal" : ", diagonal";
+    if (obj.point && !(obj.mirror_x && obj.mirror_y))
+        s += s.empty() ? "point" : ", point";
+
+    return s.empty() ? "None" : s;
+}
+
 inline std::string graph_shape_to_string(graph_shape obj)
 {
     switch (obj)
@@ -47,5 +114,158 @@ inline std::string graph_shape_to_string(graph_shape obj)
         return "Hyperbola [x^2 - y^2 < 1]";
     case graph_shape::SQUARE:
         return "Square [-1 < x < 1 && -1 < y < 1]";
+    case graph_shape::CIRCLE_MINUS_SQUARE:
+        return "Circle minus square [x^2 + y^2 < 1 && !(-0.5 < x < 0.5 && -0.5 < y < 0.5)]";
+    case graph_shape::HYPERBOLA_INTERSECTION:
+        return "Hyperbola intersection [(x - 0.5)^2 - y^2 < 1 && (x + 0.5)^2 - y^2 < 1]";
+    case graph_shape::MANDELBROT:
+        return "Mandelbrot [z = z^2 + (x + yi) from 0 stays within |z| <= 2]";
+    case graph_shape::JULIA:
+        return "Julia [z = z^2 - 0.8 + 0.156i from x + yi stays within |z| <= 2]";
+    }
+}
+
+enum class sampling_kernel
+{
+    FLAT_INDEX,
+    ROW_SWEEP,
+    SPAN,
+    LATTICE
+};
+
+constexpr int sampling_kernel_count = 4;
+
+inline std::string sampling_kernel_to_string(sampling_kernel obj)
+{
+    switch (obj)
+    {
+    case sampling_kernel::FLAT_INDEX:
+        return "Flat index [float sum]";
+    case sampling_kernel::ROW_SWEEP:
+        return "Row sweep [incremental, integer count]";
+    case sampling_kernel::SPAN:
+        return "Span [closed-form row runs, exact count]";
+    case sampling_kernel::LATTICE:
+        return "Integer lattice [fixed point, 64 bit lanes]";
+    }
+}
+
+// Single precision row sweep kernels are built with each of these accumulator counts, which is
+// also the unroll factor of their inner loop. Index 2 is the default.
+constexpr int row_sweep_variant_count = 4;
+constexpr int row_sweep_variant_accumulators[row_sweep_variant_count] = { 1, 2, 4, 8 };
+
+inline int row_sweep_variant(int accumulators)
+{
+    for (int v = 0; v < row_sweep_variant_count; v++)
+    {
+        if (row_sweep_variant_accumulators[v] == accumulators)
+            return v;
+    }
+
+    return -1;
+}
+
+// Floating point format of sample coordinates. Mixed keeps the unit origin in double and the
+// offsets of samples from it in float, so deep zooms keep float vector widths.
+enum class precision_mode
+{
+    SINGLE,
+    DOUBLE,
+    MIXED
+};
+
+constexpr int precision_mode_count = 3;
+
+inline std::string precision_mode_to_string(precision_mode obj)
+{
+    switch (obj)
+    {
+    case precision_mode::SINGLE:
+        return "Single [float]";
+    case precision_mode::DOUBLE:
+        return "Double [double]";
+    case precision_mode::MIXED:
+        return "Mixed [double origin, float offsets]";
+    }
+}
+
+// Storage of unit coverage in an in-memory graph, integer formats hold coverage scaled to their
+// full range and rounded to nearest
+enum class coverage_format
+{
+    FLOAT32,
+    UINT16,
+    UINT8
+};
+
+constexpr int coverage_format_count = 3;
+
+inline std::string coverage_format_to_string(coverage_format obj)
+{
+    switch (obj)
+    {
+    case coverage_format::FLOAT32:
+        return "Float32 [4 bytes/unit]";
+    case coverage_format::UINT16:
+        return "UInt16 [2 bytes/unit, 1/65535 steps]";
+    case coverage_format::UINT8:
+        return "UInt8 [1 byte/unit, 1/255 steps]";
+    }
+}
+
+constexpr int coverage_format_bytes(coverage_format format)
+{
+    return format == coverage_format::FLOAT32 ? 4 : format == coverage_format::UINT16 ? 2 : 1;
+}
+
+// Stored value of full coverage
+constexpr double coverage_format_max(coverage_format format)
+{
+    return format == coverage_format::FLOAT32 ? 1.0 : format == coverage_format::UINT16 ? 65535.0 : 255.0;
+}
+
+enum class unit_class
+{
+    BOUNDARY,
+    INSIDE,
+    OUTSIDE
+};
+
+enum class cull_mode
+{
+    NONE,
+    INTERVAL
+};
+
+inline std::string cull_mode_to_string(cull_mode obj)
+{
+    switch (obj)
+    {
+    case cull_mode::NONE:
+        return "None [every unit sampled]";
+    case cull_mode::INTERVAL:
+        return "Interval bounds [boundary units sampled]";
+    }
+}
+
+// Statistic a run loop reports as its score
+enum class score_statistic
+{
+    MEAN,
+    MEDIAN,
+    MAX
+};
+
+inline std::string score_statistic_to_string(score_statistic obj)
+{
+    switch (obj)
+    {
+    case score_statistic::MEAN:
+        return "Mean [outliers rejected]";
+    case score_statistic::MEDIAN:
+        return "Median [outliers rejected]";
+    case score_statistic::MAX:
+        return "Max [legacy, all runs]";
     }
 }
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+
+#include "drawxy_common.h"
+#include "drawxy_memory.h"
+
+// In-memory graph in one coverage format. Units are quantized as they are stored, so a graph takes
+// 4, 2 or 1 bytes per unit and the mean is reduced from the stored values. Storage comes from the
+// graph pool and goes back to it when the buffer is resized or destroyed.
+class coverage_buffer
+{
+public:
+    explicit coverage_buffer(coverage_format format = coverage_format::FLOAT32)
+        : format(format) {}
+
+    coverage_buffer(const coverage_buffer& other)
+        : format(other.format)
+    {
+        if (other.units > 0)
+        {
+            resize(other.units);
+            std::memcpy(block.data, other.block.data, (size_t)other.bytes());
+        }
+    }
+
+    coverage_buffer(coverage_buffer&& other) noexcept
+        : format(other.format), units(other.units), block(std::move(other.block))
+    {
+        other.units = 0;
+        other.block = graph_block();
+    }
+
+    coverage_buffer& operator=(coverage_buffer other) noexcept
+    {
+        std::swap(format, other.format);
+        std::swap(units, other.units);
+        std::swap(block, other.block);
+        return *this;
+    }
+
+    ~coverage_buffer()
+    {
+        if (block.data != nullptr)
+            get_graph_pool().release(std::move(block));
+    }
+
+    // Holds count units afterwards, contents are undefined until stored. Memory of another size is
+    // taken from the pool, fresh memory is first touched on threads pool workers.
+    graph_memory_stats resize(long long count, int threads = 1)
+    {
+        graph_memory_stats stats;
+
+        units = count;
+
+        const size_t bytes = (size_t)(count * coverage_format_bytes(format));
+
+        if (block.data != nullptr && block.requested == bytes)
+            return stats;
+
+        if (block.data != nullptr)
+            get_graph_pool().release(std::move(block));
+
+        block = acquire_graph_block(bytes, threads, stats);
+
+        return stats;
+    }
+
+    void store(long long i, float value)
+    {
+        switch (format)
+        {
+        case coverage_format::FLOAT32:
+            f32()[i] = value;
+            break;
+        case coverage_format::UINT16:
+            u16()[i] = (uint16_t)(value * 65535.0f + 0.5f);
+            break;
+        case coverage_format::UINT8:
+            u8()[i] = (uint8_t)(value * 255.0f + 0.5f);
+            break;
+        }
+    }
+
+    // Copies a stored value without converting it
+    void copy(long long to, long long from)
+    {
+        switch (format)
+        {
+        case coverage_format::FLOAT32:
+            f32()[to] = f32()[from];
+            break;
+        case coverage_format::UINT16:
+            u16()[to] = u16()[from];
+            break;
+        case coverage_format::UINT8:
+            u8()[to] = u8()[from];
+            break;
+        }
+    }
+
+    float load(long long i) const
+    {
+        switch (format)
+        {
+        case coverage_format::UINT16:
+            return u16()[i] / 65535.0f;
+        case coverage_format::UINT8:
+            return u8()[i] / 255.0f;
+        default:
+            return f32()[i];
+        }
+    }
+
+    const void* data() const
+    {
+        return block.data;
+    }
+
+    long long size() const
+    {
+        return units;
+    }
+
+    long long bytes() const
+    {
+        return units * coverage_format_bytes(format);
+    }
+
+    std::vector<float> to_float() const
+    {
+        std::vector<float> values((size_t)units);
+
+        for (long long i = 0; i < units; i++)
+            values[i] = load(i);
+
+        return values;
+    }
+
+    coverage_format format;
+
+private:
+    long long units = 0;
+    graph_block block;
+
+    float* f32() const
+    {
+        return (float*)block.data;
+    }
+
+    uint16_t* u16() const
+    {
+        return (uint16_t*)block.data;
+    }
+
+    uint8_t* u8() const
+    {
+        return (uint8_t*)block.data;
+    }
+};
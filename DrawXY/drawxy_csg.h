@@ -0,0 +1,148 @@
+#pragma once
+
+#include <ratio>
+
+#include "drawxy_common.h"
+#include "drawxy_draw_funcs.h"
+
+// Compile-time CSG: every node provides mask() for every coordinate type of the kernels, and bounds()
+// for interval classification. A composition inlines into one predicate, so a kernel evaluates all
+// of its primitives on the same coordinates and selects once on the combined mask.
+#ifdef VCL_NAMESPACE
+namespace VCL_NAMESPACE {
+#endif
+
+template <graph_shape shape> struct csg_primitive
+{
+    template <typename T> static auto mask(const T x_v, const T y_v)
+    {
+        return draw_mask<T, shape>(x_v, y_v);
+    }
+
+    static const unit_class bounds(const interval x_i, const interval y_i)
+    {
+        return draw_bounds<shape>(x_i, y_i);
+    }
+};
+
+template <typename A, typename B> struct csg_union
+{
+    template <typename T> static auto mask(const T x_v, const T y_v)
+    {
+        return A::mask(x_v, y_v) || B::mask(x_v, y_v);
+    }
+
+    static const unit_class bounds(const interval x_i, const interval y_i)
+    {
+        const unit_class a = A::bounds(x_i, y_i);
+        const unit_class b = B::bounds(x_i, y_i);
+
+        if (a == unit_class::INSIDE || b == unit_class::INSIDE)
+            return unit_class::INSIDE;
+        if (a == unit_class::OUTSIDE && b == unit_class::OUTSIDE)
+            return unit_class::OUTSIDE;
+
+        return unit_class::BOUNDARY;
+    }
+};
+
+template <typename A, typename B> struct csg_intersection
+{
+    template <typename T> static auto mask(const T x_v, const T y_v)
+    {
+        return A::mask(x_v, y_v) && B::mask(x_v, y_v);
+    }
+
+    static const unit_class bounds(const interval x_i, const interval y_i)
+    {
+        const unit_class a = A::bounds(x_i, y_i);
+        const unit_class b = B::bounds(x_i, y_i);
+
+        if (a == unit_class::OUTSIDE || b == unit_class::OUTSIDE)
+            return unit_class::OUTSIDE;
+        if (a == unit_class::INSIDE && b == unit_class::INSIDE)
+            return unit_class::INSIDE;
+
+        return unit_class::BOUNDARY;
+    }
+};
+
+template <typename A, typename B> struct csg_difference
+{
+    template <typename T> static auto mask(const T x_v, const T y_v)
+    {
+        return A::mask(x_v, y_v) && !B::mask(x_v, y_v);
+    }
+
+    static const unit_class bounds(const interval x_i, const interval y_i)
+    {
+        const unit_class a = A::bounds(x_i, y_i);
+        const unit_class b = B::bounds(x_i, y_i);
+
+        if (a == unit_class::OUTSIDE || b == unit_class::INSIDE)
+            return unit_class::OUTSIDE;
+        if (a == unit_class::INSIDE && b == unit_class::OUTSIDE)
+            return unit_class::INSIDE;
+
+        return unit_class::BOUNDARY;
+    }
+};
+
+// Moves A by (DX, DY), given as std::ratio
+template <typename A, typename DX, typename DY> struct csg_translate
+{
+    static constexpr double dx = (double)DX::num / DX::den;
+    static constexpr double dy = (double)DY::num / DY::den;
+
+    template <typename T> static auto mask(const T x_v, const T y_v)
+    {
+        return A::mask(x_v - T(dx), y_v - T(dy));
+    }
+
+    static const unit_class bounds(const interval x_i, const interval y_i)
+    {
+        return A::bounds({ x_i.lo - dx, x_i.hi - dx }, { y_i.lo - dy, y_i.hi - dy });
+    }
+};
+
+// Scales A by positive factors (SX, SY), given as std::ratio
+template <typename A, typename SX, typename SY> struct csg_scale
+{
+    static_assert(SX::num > 0 && SY::num > 0, "csg_scale factors must be positive");
+
+    static constexpr double inv_sx = (double)SX::den / SX::num;
+    static constexpr double inv_sy = (double)SY::den / SY::num;
+
+    template <typename T> static auto mask(const T x_v, const T y_v)
+    {
+        return A::mask(x_v * T(inv_sx), y_v * T(inv_sy));
+    }
+
+    static const unit_class bounds(const interval x_i, const interval y_i)
+    {
+        return A::bounds({ x_i.lo * inv_sx, x_i.hi * inv_sx }, { y_i.lo * inv_sy, y_i.hi * inv_sy });
+    }
+};
+
+template <> struct csg_shape<graph_shape::CIRCLE_MINUS_SQUARE>
+{
+    typedef csg_difference<
+        csg_primitive<graph_shape::CIRCLE>,
+        csg_scale<csg_primitive<graph_shape::SQUARE>, std::ratio<1, 2>, std::ratio<1, 2>>> type;
+};
+
+template <> constexpr symmetry_group shape_symmetry<graph_shape::CIRCLE_MINUS_SQUARE> = { true, true, true, true };
+
+template <> struct csg_shape<graph_shape::HYPERBOLA_INTERSECTION>
+{
+    typedef csg_intersection<
+        csg_translate<csg_primitive<graph_shape::HYPERBOLA>, std::ratio<1, 2>, std::ratio<0>>,
+        csg_translate<csg_primitive<graph_shape::HYPERBOLA>, std::ratio<-1, 2>, std::ratio<0>>> type;
+};
+
+// The x mirror swaps the two translated hyperbolas
+template <> constexpr symmetry_group shape_symmetry<graph_shape::HYPERBOLA_INTERSECTION> = { true, true, false, true };
+
+#ifdef VCL_NAMESPACE
+}
+#endif
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vectorclass.h>
+#include <iostream>
+
+#include "drawxy_common.h"
+#include "drawxy_structs.h"
+
+// One kernel build per instruction set, each compiled with its own target flags
+namespace drawxy_scalar { const kernel_table& get_kernel_table(); }
+namespace drawxy_sse41 { const kernel_table& get_kernel_table(); }
+namespace drawxy_avx2 { const kernel_table& get_kernel_table(); }
+namespace drawxy_avx512 { const kernel_table& get_kernel_table(); }
+
+inline const kernel_table& get_kernel_table(vectorization_level vl)
+{
+    switch (vl)
+    {
+    case vectorization_level::SSE4:
+        return drawxy_sse41::get_kernel_table();
+    case vectorization_level::AVX2:
+        return drawxy_avx2::get_kernel_table();
+    case vectorization_level::AVX512:
+        return drawxy_avx512::get_kernel_table();
+    default:
+        return drawxy_scalar::get_kernel_table();
+    }
+}
+
+// Highest vectorization level the running CPU can execute, from CPUID
+inline vectorization_level detect_vec_level()
+{
+    const int iset = instrset_detect();
+
+    // The AVX-512 build uses F, VL, BW and DQ; the AVX2 build also uses FMA3
+    if (iset >= 10)
+        return vectorization_level::AVX512;
+    if (iset >= 8 && hasFMA3())
+        return vectorization_level::AVX2;
+    if (iset >= 5)
+        return vectorization_level::SSE4;
+
+    return vectorization_level::NONE;
+}
+
+// Forced levels above what the CPU supports are clamped to the detected level
+inline vectorization_level select_vec_level(vectorization_level detected, vectorization_level forced)
+{
+    if ((int)forced < 0 || (int)forced >= vec_level_count)
+    {
+        std::cout << "Unknown vectorization level " << (int)forced << ", using detected level" << std::endl;
+        return detected;
+    }
+
+    if (forced > detected)
+    {
+        std::cout << "Vectorization level " << vec_level_to_string(forced) << " not supported by this CPU" << std::endl;
+        return detected;
+    }
+
+    return forced;
+}
+
+// Best kernel for a shape at or below the given level
+inline calc_avg_func select_calc_avg(vectorization_level vl, sampling_kernel kernel, graph_shape shape)
+{
+    for (int l = (int)vl; l >= 0; l--)
+    {
+        const calc_avg_func func = get_kernel_table((vectorization_level)l).calc_avg[(int)kernel][(int)shape];
+
+        if (func != nullptr)
+            return func;
+    }
+
+    return nullptr;
+}
+
+// Row sweep kernel with the accumulator count of a variant
+inline calc_avg_func select_calc_avg_rows_variant(vectorization_level vl, int variant, graph_shape shape)
+{
+    return get_kernel_table(vl).calc_avg_rows_variant[variant][(int)shape];
+}
+
+// Kernel of the double or mixed precision mode
+inline calc_avg_precise_func select_calc_avg_precise(vectorization_level vl, precision_mode precision, graph_shape shape)
+{
+    const kernel_table& table = get_kernel_table(vl);
+
+    return precision == precision_mode::DOUBLE ? table.calc_avg_double[(int)shape] : table.calc_avg_mixed[(int)shape];
+}
+
+inline calc_escape_func select_calc_escape(vectorization_level vl, precision_mode precision, graph_shape shape)
+{
+    return get_kernel_table(vl).calc_escape[(int)precision][escape_shape_index(shape)];
+}
+
+inline classify_func select_classify(vectorization_level vl, graph_shape shape)
+{
+    return get_kernel_table(vl).classify[(int)shape];
+}
+
+inline calc_program_func select_calc_program(vectorization_level vl)
+{
+    return get_kernel_table(vl).calc_program;
+}
+
+inline calc_batch_func select_calc_batch(vectorization_level vl)
+{
+    return get_kernel_table(vl).calc_batch;
+}
+
+inline symmetry_group select_symmetry(vectorization_level vl, graph_shape shape)
+{
+    return get_kernel_table(vl).symmetry[(int)shape];
+}
+
+inline bool select_span(vectorization_level vl, graph_shape shape)
+{
+    return get_kernel_table(vl).span[(int)shape];
+}
+
+inline bool select_lattice(vectorization_level vl, graph_shape shape)
+{
+    return get_kernel_table(vl).lattice[(int)shape];
+}
+
+inline lattice_mirror_func select_lattice_mirror(vectorization_level vl, graph_shape shape)
+{
+    return get_kernel_table(vl).lattice_mirror[(int)shape];
+}
+
+inline coverage_sum_func select_coverage_sum(vectorization_level vl, coverage_format format)
+{
+    return get_kernel_table(vl).coverage_sum[(int)format];
+}
@@ -1,40 +1,157 @@
 #pragma once
 
+#include <vectorclass.h>
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
 #include "drawxy_common.h"
 
+// Kernels are compiled once per instruction set (see drawxy_kernels_*.cpp),
+// each build living in its own VCL_NAMESPACE
+#ifdef VCL_NAMESPACE
+namespace VCL_NAMESPACE {
+#endif
+
+const Vec4f one_v4(1);
+const Vec4f none_v4(-1);
+const Vec4f zero_v4(0);
+
+const Vec4f ci_v4(0, 1, 2, 3);
+
+const Vec8f one_v(1);
+const Vec8f none_v(-1);
+const Vec8f zero_v(0);
+
+const Vec8f ci_v8(0, 1, 2, 3, 4, 5, 6, 7);
+
+const Vec16f one_v16(1);
+const Vec16f none_v16(-1);
+const Vec16f zero_v16(0);
+
+const Vec16f ci_v16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
 //template <typename T> const T func_dummy(const T, const T);
 //template <typename T> const T func_circle(const T, const T);
 //template <typename T> const T func_hyperb(const T, const T);
 //template <typename T> const T func_square(const T, const T);
 
+// Composite shapes, built from the primitives in this file by drawxy_csg.h
+template <graph_shape shape> struct csg_shape;
+
 template <typename T, graph_shape shape> const T draw_func(T, T);
 
+// Symmetries of each shape's region, declared next to its draw_func. Symmetric views only
+// evaluate one unit of each mirrored set.
+template <graph_shape shape> constexpr symmetry_group shape_symmetry = {};
+
+template <> constexpr symmetry_group shape_symmetry<graph_shape::EMPTY> = { true, true, true, true };
+
+// Shapes whose hits in a sample row are the columns with |x| below a half width that depends on y.
+// The span kernel estimates the run of hit columns from half_width_sq and walks its ends with the
+// shape's predicate, so it counts exactly the samples the sampling kernels count.
+template <graph_shape shape> struct shape_span
+{
+    static constexpr bool enabled = false;
+};
+
+// Shapes the integer lattice kernel evaluates exactly. With samples at x = i h and y = j h for
+// integers i and j, a sample hits when i^2 + row_term(j^2) < t, t being 1 / h^2 rounded up, on rows
+// where row_hit(j^2, t) holds.
+template <graph_shape shape> struct shape_lattice
+{
+    static constexpr bool enabled = false;
+};
+
 template <> const float draw_func<float, graph_shape::EMPTY>(const float x, const float y)
 {
     return 0.0f;
 }
 
+template <> const Vec4f draw_func<Vec4f, graph_shape::EMPTY>(const Vec4f x_v, const Vec4f y_v)
+{
+    return zero_v4;
+}
+
 template <> const Vec8f draw_func<Vec8f, graph_shape::EMPTY>(const Vec8f x_v, const Vec8f y_v)
 {
     return zero_v;
 }
 
+template <> const Vec16f draw_func<Vec16f, graph_shape::EMPTY>(const Vec16f x_v, const Vec16f y_v)
+{
+    return zero_v16;
+}
+
+template <> constexpr symmetry_group shape_symmetry<graph_shape::CIRCLE> = { true, true, true, true };
+
 template <> const float draw_func<float, graph_shape::CIRCLE>(const float x, const float y)
 {
     float n = x * x + y * y;
     return n < 1.0f ? 1.0f : 0.0f;
 }
 
+template <> const Vec4f draw_func<Vec4f, graph_shape::CIRCLE>(const Vec4f x_v, const Vec4f y_v)
+{
+    Vec4f r_v = square(x_v) + square(y_v);
+    return select(r_v < one_v4, one_v4, zero_v4);
+}
+
 template <> const Vec8f draw_func<Vec8f, graph_shape::CIRCLE>(const Vec8f x_v, const Vec8f y_v)
 {
     Vec8f r_v = square(x_v) + square(y_v);
     return select(r_v < one_v, one_v, zero_v);
 }
 
+template <> const Vec16f draw_func<Vec16f, graph_shape::CIRCLE>(const Vec16f x_v, const Vec16f y_v)
+{
+    Vec16f r_v = square(x_v) + square(y_v);
+    Vec16fb mask_v = r_v < one_v16;
+
+    return select(mask_v, one_v16, zero_v16);
+}
+
+template <> struct shape_span<graph_shape::CIRCLE>
+{
+    static constexpr bool enabled = true;
+
+    // Negative when the row misses the circle
+    template <typename T> static T half_width_sq(const T y)
+    {
+        return (T(1.0f) - y) * (T(1.0f) + y);
+    }
+};
+
+template <> struct shape_lattice<graph_shape::CIRCLE>
+{
+    static constexpr bool enabled = true;
+
+    static bool row_hit(const long long, const long long) { return true; }
+    static long long row_term(const long long j2) { return j2; }
+};
+
+template <> constexpr symmetry_group shape_symmetry<graph_shape::HYPERBOLA> = { true, true, false, true };
+
+template <> struct shape_span<graph_shape::HYPERBOLA>
+{
+    static constexpr bool enabled = true;
+
+    template <typename T> static T half_width_sq(const T y)
+    {
+        return T(1.0f) + y * y;
+    }
+};
+
 template <> const float draw_func<float, graph_shape::HYPERBOLA>(const float x, const float y)
 {
     float n = x * x - y * y;
-    return n > 1.0f ? 1.0f : 0.0f;
+    return n < 1.0f ? 1.0f : 0.0f;
+}
+
+template <> const Vec4f draw_func<Vec4f, graph_shape::HYPERBOLA>(const Vec4f x_v, const Vec4f y_v)
+{
+    Vec4f r_v = square(x_v) - square(y_v);
+    return select(r_v < one_v4, one_v4, zero_v4);
 }
 
 template <> const Vec8f draw_func<Vec8f, graph_shape::HYPERBOLA>(const Vec8f x_v, const Vec8f y_v)
@@ -43,14 +160,320 @@ template <> const Vec8f draw_func<Vec8f, graph_shape::HYPERBOLA>(const Vec8f x_v
     return select(r_v < one_v, one_v, zero_v);
 }
 
+template <> const Vec16f draw_func<Vec16f, graph_shape::HYPERBOLA>(const Vec16f x_v, const Vec16f y_v)
+{
+    Vec16f r_v = square(x_v) - square(y_v);
+    Vec16fb mask_v = r_v < one_v16;
+
+    return select(mask_v, one_v16, zero_v16);
+}
+
+template <> struct shape_lattice<graph_shape::HYPERBOLA>
+{
+    static constexpr bool enabled = true;
+
+    static bool row_hit(const long long, const long long) { return true; }
+    static long long row_term(const long long j2) { return -j2; }
+};
+
+template <> constexpr symmetry_group shape_symmetry<graph_shape::SQUARE> = { true, true, true, true };
+
+// -1 < x < 1 is i^2 < t, the same for y decides the row
+template <> struct shape_lattice<graph_shape::SQUARE>
+{
+    static constexpr bool enabled = true;
+
+    static bool row_hit(const long long j2, const long long t) { return j2 < t; }
+    static long long row_term(const long long) { return 0; }
+};
+
+// Rows outside -1 < y < 1 are found missing by the predicate at the column closest to x = 0
+template <> struct shape_span<graph_shape::SQUARE>
+{
+    static constexpr bool enabled = true;
+
+    template <typename T> static T half_width_sq(const T)
+    {
+        return T(1.0f);
+    }
+};
+
 template <> const float draw_func<float, graph_shape::SQUARE>(const float x, const float y)
 {
     return x > -1.0f && x < 1.0f && y > -1.0f && y < 1.0f ? 1.0f : 0.0f;
 }
 
+template <> const Vec4f draw_func<Vec4f, graph_shape::SQUARE>(const Vec4f x_v, const Vec4f y_v)
+{
+    Vec4fb mask_v = (x_v > none_v4) && (x_v < one_v4) && (y_v > none_v4) && (y_v < one_v4);
+
+    return select(mask_v, one_v4, zero_v4);
+}
+
 template <> const Vec8f draw_func<Vec8f, graph_shape::SQUARE>(const Vec8f x_v, const Vec8f y_v)
 {
     Vec8fb mask_v = (x_v > none_v) && (x_v < one_v) && (y_v > none_v) && (y_v < one_v);
 
     return select(mask_v, one_v, zero_v);
 }
+
+template <> const Vec16f draw_func<Vec16f, graph_shape::SQUARE>(const Vec16f x_v, const Vec16f y_v)
+{
+    Vec16fb mask_v = (x_v > none_v16) && (x_v < one_v16) && (y_v > none_v16) && (y_v < one_v16);
+
+    return select(mask_v, one_v16, zero_v16);
+}
+
+// Coordinate of mixed precision kernels: a double origin shared by all lanes and float offsets
+// of the samples from it. Shapes are expanded around the origin, so only small terms are rounded
+// to float and sample coordinates do not collapse at deep zooms.
+template <typename V> struct offset_coord
+{
+    double origin;
+    V delta;
+
+    offset_coord(const double origin, const V delta)
+        : origin(origin), delta(delta) {}
+
+    // Constant coordinate, as used by CSG transforms
+    explicit offset_coord(const double c)
+        : origin(c), delta(0.0f) {}
+};
+
+template <typename V> const offset_coord<V> operator-(const offset_coord<V> a, const offset_coord<V> b)
+{
+    return { a.origin - b.origin, a.delta - b.delta };
+}
+
+// Only scaling by a constant (b.delta == 0) is supported
+template <typename V> const offset_coord<V> operator*(const offset_coord<V> a, const offset_coord<V> b)
+{
+    return { a.origin * b.origin, a.delta * V((float)b.origin) };
+}
+
+template <typename T> struct is_offset_coord : std::false_type {};
+template <typename V> struct is_offset_coord<offset_coord<V>> : std::true_type {};
+
+// Primitive predicates around the origin (X, Y) with offsets (dx, dy),
+// e.g. x^2 + y^2 - 1 = (X^2 + Y^2 - 1) + dx (2X + dx) + dy (2Y + dy)
+template <typename V, graph_shape shape> const auto draw_mask_offset(const offset_coord<V> x_c, const offset_coord<V> y_c)
+{
+    const double x0 = x_c.origin;
+    const double y0 = y_c.origin;
+    const V dx = x_c.delta;
+    const V dy = y_c.delta;
+
+    if constexpr (shape == graph_shape::CIRCLE)
+    {
+        return V((float)(x0 * x0 + y0 * y0 - 1.0)) + dx * (V((float)(2.0 * x0)) + dx) + dy * (V((float)(2.0 * y0)) + dy) < V(0.0f);
+    }
+    else if constexpr (shape == graph_shape::HYPERBOLA)
+    {
+        return V((float)(x0 * x0 - y0 * y0 - 1.0)) + dx * (V((float)(2.0 * x0)) + dx) - dy * (V((float)(2.0 * y0)) + dy) < V(0.0f);
+    }
+    else if constexpr (shape == graph_shape::SQUARE)
+    {
+        return (dx > V((float)(-1.0 - x0))) && (dx < V((float)(1.0 - x0))) && (dy > V((float)(-1.0 - y0))) && (dy < V((float)(1.0 - y0)));
+    }
+    else
+    {
+        return decltype(dx < dy)(false);
+    }
+}
+
+// Julia set constant c
+constexpr double julia_cx = -0.8;
+constexpr double julia_cy = 0.156;
+
+// The Mandelbrot set is its own complex conjugate, Julia orbits of -z are the orbits of z negated
+template <> constexpr symmetry_group shape_symmetry<graph_shape::MANDELBROT> = { false, true, false, false };
+template <> constexpr symmetry_group shape_symmetry<graph_shape::JULIA> = { false, false, false, true };
+
+inline bool any_lane(const bool m) { return m; }
+template <typename M> bool any_lane(const M m) { return horizontal_or(m); }
+
+// Lanes whose orbit stays within |z| <= 2 for max_iterations steps of z = z^2 + c. Iteration stops
+// once every lane has escaped, escaped lanes are frozen by the active mask.
+template <typename T, graph_shape shape> const auto escape_mask(const T x_v, const T y_v, const int max_iterations)
+{
+    const T c_x = shape == graph_shape::MANDELBROT ? x_v : T(julia_cx);
+    const T c_y = shape == graph_shape::MANDELBROT ? y_v : T(julia_cy);
+
+    T z_x = shape == graph_shape::MANDELBROT ? T(0.0f) : x_v;
+    T z_y = shape == graph_shape::MANDELBROT ? T(0.0f) : y_v;
+
+    auto active = z_x * z_x + z_y * z_y <= T(4.0f);
+
+    for (int i = 0; i < max_iterations && any_lane(active); i++)
+    {
+        const T x2 = z_x * z_x;
+        const T y2 = z_y * z_y;
+
+        if constexpr (std::is_arithmetic_v<T>)
+        {
+            z_y = T(2) * z_x * z_y + c_y;
+            z_x = x2 - y2 + c_x;
+        }
+        else
+        {
+            z_y = select(active, T(2.0f) * z_x * z_y + c_y, z_y);
+            z_x = select(active, x2 - y2 + c_x, z_x);
+        }
+
+        active = active && (z_x * z_x + z_y * z_y <= T(4.0f));
+    }
+
+    return active;
+}
+
+// Same predicates as draw_func, returned as a lane mask (bool for scalars) so hits can be counted.
+// Escape-time shapes use escape_default_iterations here, kernels with a runtime limit call escape_mask.
+template <typename T, graph_shape shape> const auto draw_mask(const T x_v, const T y_v)
+{
+    if constexpr (is_offset_coord<T>::value && shape <= graph_shape::SQUARE)
+    {
+        return draw_mask_offset<decltype(x_v.delta), shape>(x_v, y_v);
+    }
+    else if constexpr (is_offset_coord<T>::value && is_escape_shape(shape))
+    {
+        // Orbits need absolute coordinates, so the split coordinate is joined in float
+        typedef decltype(x_v.delta) V;
+        return escape_mask<V, shape>(V((float)x_v.origin) + x_v.delta, V((float)y_v.origin) + y_v.delta, escape_default_iterations);
+    }
+    else if constexpr (is_escape_shape(shape))
+    {
+        return escape_mask<T, shape>(x_v, y_v, escape_default_iterations);
+    }
+    else if constexpr (shape == graph_shape::CIRCLE)
+    {
+        return x_v * x_v + y_v * y_v < T(1.0f);
+    }
+    else if constexpr (shape == graph_shape::HYPERBOLA)
+    {
+        return x_v * x_v - y_v * y_v < T(1.0f);
+    }
+    else if constexpr (shape == graph_shape::SQUARE)
+    {
+        return (x_v > T(-1.0f)) && (x_v < T(1.0f)) && (y_v > T(-1.0f)) && (y_v < T(1.0f));
+    }
+    else if constexpr (shape == graph_shape::EMPTY)
+    {
+        return decltype(x_v < y_v)(false);
+    }
+    else
+    {
+        return csg_shape<shape>::type::mask(x_v, y_v);
+    }
+}
+
+// Shapes without a hand-written draw_func select once on their combined mask
+template <typename T, graph_shape shape> const T draw_func(const T x_v, const T y_v)
+{
+    if constexpr (std::is_arithmetic_v<T>)
+    {
+        return draw_mask<T, shape>(x_v, y_v) ? T(1) : T(0);
+    }
+    else
+    {
+        return select(draw_mask<T, shape>(x_v, y_v), T(1.0f), T(0.0f));
+    }
+}
+
+// Conservative bounds over a whole unit, evaluated in double with a margin that covers the
+// float rounding of sample coordinates and of the draw_func predicates
+constexpr double bounds_margin = 1e-5;
+
+struct interval
+{
+    double lo;
+    double hi;
+};
+
+inline const interval operator+(const interval a, const interval b)
+{
+    return { a.lo + b.lo, a.hi + b.hi };
+}
+
+inline const interval operator-(const interval a, const interval b)
+{
+    return { a.lo - b.hi, a.hi - b.lo };
+}
+
+inline const interval square(const interval a)
+{
+    if (a.lo >= 0.0)
+        return { a.lo * a.lo, a.hi * a.hi };
+    if (a.hi <= 0.0)
+        return { a.hi * a.hi, a.lo * a.lo };
+
+    return { 0.0, std::max(a.lo * a.lo, a.hi * a.hi) };
+}
+
+// Classifies v < limit over an interval of v
+inline const unit_class classify_less(const interval v, const double limit)
+{
+    const double margin = bounds_margin * (1.0 + std::abs(limit));
+
+    if (v.hi < limit - margin)
+        return unit_class::INSIDE;
+    if (v.lo > limit + margin)
+        return unit_class::OUTSIDE;
+
+    return unit_class::BOUNDARY;
+}
+
+template <graph_shape shape> const unit_class draw_bounds(const interval x_i, const interval y_i)
+{
+    return csg_shape<shape>::type::bounds(x_i, y_i);
+}
+
+template <> const unit_class draw_bounds<graph_shape::EMPTY>(const interval, const interval)
+{
+    return unit_class::OUTSIDE;
+}
+
+template <> const unit_class draw_bounds<graph_shape::CIRCLE>(const interval x_i, const interval y_i)
+{
+    return classify_less(square(x_i) + square(y_i), 1.0);
+}
+
+template <> const unit_class draw_bounds<graph_shape::HYPERBOLA>(const interval x_i, const interval y_i)
+{
+    return classify_less(square(x_i) - square(y_i), 1.0);
+}
+
+// Units entirely outside |c| <= 2 escape on the first step; anything else needs sampling
+template <> const unit_class draw_bounds<graph_shape::MANDELBROT>(const interval x_i, const interval y_i)
+{
+    return classify_less(square(x_i) + square(y_i), 4.0) == unit_class::OUTSIDE ? unit_class::OUTSIDE : unit_class::BOUNDARY;
+}
+
+// With |c| < 2, starting points outside |z| <= 2 never return
+template <> const unit_class draw_bounds<graph_shape::JULIA>(const interval x_i, const interval y_i)
+{
+    return classify_less(square(x_i) + square(y_i), 4.0) == unit_class::OUTSIDE ? unit_class::OUTSIDE : unit_class::BOUNDARY;
+}
+
+template <> const unit_class draw_bounds<graph_shape::SQUARE>(const interval x_i, const interval y_i)
+{
+    const unit_class classes[] = {
+        classify_less({ -x_i.hi, -x_i.lo }, 1.0), classify_less(x_i, 1.0),
+        classify_less({ -y_i.hi, -y_i.lo }, 1.0), classify_less(y_i, 1.0)
+    };
+
+    unit_class result = unit_class::INSIDE;
+
+    for (const unit_class c : classes)
+    {
+        if (c == unit_class::OUTSIDE)
+            return unit_class::OUTSIDE;
+        if (c == unit_class::BOUNDARY)
+            result = unit_class::BOUNDARY;
+    }
+
+    return result;
+}
+
+#ifdef VCL_NAMESPACE
+}
+#endif
@@ -0,0 +1,1090 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <cmath>
+
+#include "drawxy_common.h"
+#include "drawxy_structs.h"
+#include "drawxy_dispatch.h"
+#include "drawxy_graph_funcs.h"
+#include "drawxy_run.h"
+#include "drawxy_shape_dsl.h"
+#include "drawxy_host.h"
+#include "drawxy_report.h"
+#include "drawxy_scaling.h"
+#include "drawxy_precision.h"
+#include "drawxy_topology.h"
+#include "drawxy_tuning.h"
+#include "drawxy_batch.h"
+#include "drawxy_animation.h"
+
+// Command line and config file names, in enum order
+constexpr const char* shape_tokens[graph_shape_count] = { "empty", "circle", "hyperbola", "square", "circle_minus_square", "hyperbola_intersection",
+    "mandelbrot", "julia" };
+constexpr const char* vec_level_tokens[vec_level_count] = { "none", "sse4", "avx2", "avx512" };
+constexpr const char* bench_tokens[] = { "multisample", "fixedtime" };
+constexpr const char* kernel_tokens[sampling_kernel_count] = { "flat", "rows", "span", "lattice" };
+constexpr const char* cull_tokens[] = { "none", "interval" };
+constexpr const char* format_tokens[] = { "json", "csv" };
+constexpr const char* statistic_tokens[] = { "mean", "median", "max" };
+constexpr const char* placement_tokens[thread_placement_count] = { "none", "smt_on", "smt_off" };
+constexpr const char* precision_tokens[precision_mode_count] = { "single", "double", "mixed" };
+constexpr const char* image_format_tokens[] = { "pgm8", "pgm16", "raw" };
+constexpr const char* coverage_tokens[coverage_format_count] = { "float32", "uint16", "uint8" };
+constexpr const char* huge_page_tokens[huge_page_mode_count] = { "none", "transparent", "explicit" };
+
+// Benchmark matrix: every combination of benches, shapes (built-in and programs), vec_levels,
+// threads, sizes and samples is run `loops` times, each run is written as one record
+struct driver_options
+{
+    std::vector<bench_type> benches = { bench_type::MULTISAMPLE };
+    std::vector<graph_shape> shapes = { graph_shape::CIRCLE };
+    std::vector<std::string> programs;
+    std::vector<vectorization_level> vec_levels;
+    std::vector<int> threads = { 1 };
+    std::vector<int> sizes = { 32 };
+    std::vector<int> samples = { 4096 };
+
+    // Empty means none for the matrix and smt_on,smt_off for scaling sweeps
+    std::vector<thread_placement> placements;
+
+    std::vector<precision_mode> precisions = { precision_mode::SINGLE };
+    std::vector<coverage_format> coverages = { coverage_format::FLOAT32 };
+    huge_page_mode huge_pages = huge_page_mode::NONE;
+    bool no_graph_pool = false;
+    double zoom = 1.0;
+    double center_x = 0.0;
+    double center_y = 0.0;
+    double tolerance = precision_tolerance;
+    int max_iterations = escape_default_iterations;
+
+    sampling_kernel kernel = sampling_kernel::ROW_SWEEP;
+    cull_mode cull = cull_mode::NONE;
+    int grain = 1;
+    int loops = 5;
+    long long time = 5000;
+    loop_policy loop;
+    long long timeline_interval = 50;
+    double throttle_threshold = 0.1;
+
+    record_format format = record_format::JSON;
+    std::string output;
+
+    // Tiled image output of multisample runs, every run rewrites the image
+    std::string image;
+    image_format image_type = image_format::PGM8;
+    int tile_size = 256;
+    int tiles_in_flight = 0;
+    bool scaling = false;
+    bool compare_precision = false;
+    bool counters = false;
+    bool no_symmetry = false;
+    bool progressive = false;
+    bool batch = false;
+
+    // Animation along a path of keyframes, replacing the zoom and center of the matrix when set
+    std::vector<view_keyframe> path;
+    int frames = 60;
+    int frames_in_flight = default_frames_in_flight;
+
+    // Tuned settings are loaded for every built-in shape unless disabled, options given explicitly win
+    bool tune = false;
+    bool no_profile = false;
+    std::string profile = default_profile_path;
+
+    // Options set from the command line or a config file
+    std::set<std::string> given;
+
+    bool quiet = false;
+    bool help = false;
+};
+
+inline void print_driver_usage(std::ostream& out)
+{
+    out << "Usage: DrawXY [--option value ...]" << std::endl;
+    out << "  List options take comma separated values, every combination is run." << std::endl;
+    out << "  --bench      multisample,fixedtime              (default multisample)" << std::endl;
+    out << "  --shape      empty,circle,hyperbola,square,circle_minus_square,hyperbola_intersection," << std::endl;
+    out << "               mandelbrot,julia" << std::endl;
+    out << "               or none to run only programs       (default circle)" << std::endl;
+    out << "  --program    shape expression, e.g. \"x^2 + y^2 < 1\" (repeatable, runs after --shape)" << std::endl;
+    out << "  --vec        none,sse4,avx2,avx512,auto,all     (default auto = detected level)" << std::endl;
+    out << "  --threads    thread counts, max = all logical CPUs (default 1)" << std::endl;
+    out << "  --size       display sizes                      (default 32)" << std::endl;
+    out << "  --samples    samples per unit axis              (default 4096)" << std::endl;
+    out << "  --placement  none,smt_on,smt_off worker pinning (default none)" << std::endl;
+    out << "  --scaling    sweep threads 1, 2, 4, ... up to the CPU count instead of --threads," << std::endl;
+    out << "               one record per point with speedup, efficiency and serial fraction" << std::endl;
+    out << "  --iterations escape-time shape iteration limit  (default 256)" << std::endl;
+    out << "  --precision  single,double,mixed coordinates    (default single)" << std::endl;
+    out << "  --zoom       magnification of the [-2, 2] view  (default 1)" << std::endl;
+    out << "  --center     view center as x,y                 (default 0,0)" << std::endl;
+    out << "  --coverage   float32,uint16,uint8 in-memory graph storage (default float32)" << std::endl;
+    out << "  --huge-pages none, transparent (THP hint) or explicit (reserved pages) for graphs (default none)" << std::endl;
+    out << "  --no-graph-pool" << std::endl;
+    out << "               map and first touch every run's graphs again instead of reusing them" << std::endl;
+    out << "  --compare-precision" << std::endl;
+    out << "               run every precision instead of --precision, one record per precision with its" << std::endl;
+    out << "               throughput relative to single and its largest unit error against double" << std::endl;
+    out << "  --tolerance  largest unit error still counted as correct (default 0.001)" << std::endl;
+    out << "  --kernel     flat, rows, span (exact row runs) or lattice (fixed point integer lattice), span and" << std::endl;
+    out << "               lattice cover circle, hyperbola and square (default rows)" << std::endl;
+    out << "  --cull       none or interval                   (default none)" << std::endl;
+    out << "  --grain      units per scheduled chunk          (default 1)" << std::endl;
+    out << "  --loops      measured runs per combination      (default 5)" << std::endl;
+    out << "  --warmup     unrecorded runs before measuring   (default 1)" << std::endl;
+    out << "  --ci         keep running until the 95% CI is within +- this fraction of the mean," << std::endl;
+    out << "               e.g. 0.01, 0 runs exactly --loops  (default 0)" << std::endl;
+    out << "  --max-loops  run limit when --ci is set         (default 50)" << std::endl;
+    out << "  --outlier    reject runs this many scaled MADs from the median, 0 keeps all (default 3)" << std::endl;
+    out << "  --statistic  mean, median or max (legacy)       (default mean)" << std::endl;
+    out << "  --time       fixed time benchmark length in ms  (default 5000)" << std::endl;
+    out << "  --interval   fixed time throughput sampling in ms, 0 disables the timeline (default 50)" << std::endl;
+    out << "  --throttle   late vs early throughput drop that flags throttling (default 0.1)" << std::endl;
+    out << "  --format     json (one object per line) or csv  (default json)" << std::endl;
+    out << "  --output     record file, appended to when it holds records of the same columns, records go to" << std::endl;
+    out << "               stdout when omitted" << std::endl;
+    out << "  --image      render multisample runs in tiles written to this file as they finish," << std::endl;
+    out << "               memory is bounded by tiles in flight instead of size^2" << std::endl;
+    out << "  --image-format pgm8, pgm16 or raw (float, memory mapped) (default pgm8)" << std::endl;
+    out << "  --tile       tile edge in units                 (default 256)" << std::endl;
+    out << "  --tiles-in-flight" << std::endl;
+    out << "               tile buffers rendering or waiting to be written, 0 = 2 per thread (default 0)" << std::endl;
+    out << "  --config     file of \"option = value\" lines, # starts a comment" << std::endl;
+    out << "  --counters   count cycles, instructions, FP ops and misses of every kernel call" << std::endl;
+    out << "               (Linux perf events, reported as unavailable elsewhere)" << std::endl;
+    out << "  --progressive" << std::endl;
+    out << "               render multisample runs coarse to fine, reporting time to first preview and to final" << std::endl;
+    out << "  --no-symmetry" << std::endl;
+    out << "               compute every unit, symmetric shapes and views otherwise mirror units across the diagonal" << std::endl;
+    out << "               and, with the lattice kernel, across the axes" << std::endl;
+    out << "  --batch      render the built-in shapes of each combination in one pass sharing sample coordinates," << std::endl;
+    out << "               compared with running each shape alone (single precision, no escape-time shapes)" << std::endl;
+    out << "  --path       render an animation along keyframes zoom:x:y,zoom:x:y,... instead of one view," << std::endl;
+    out << "               zoom is interpolated geometrically and the center linearly between keyframes" << std::endl;
+    out << "  --frames     frames of an animation             (default 60)" << std::endl;
+    out << "  --frames-in-flight" << std::endl;
+    out << "               recycled frame buffers, frames rendering at once (default 2)" << std::endl;
+    out << "  --tune       search vec level, kernel variant, threads and grain for each built-in shape at the" << std::endl;
+    out << "               first size and samples, and save the fastest to the profile" << std::endl;
+    out << "  --profile    tuning profile file, keyed by CPU model (default drawxy_profile.tsv)" << std::endl;
+    out << "  --no-profile ignore the tuning profile, defaults apply to options not given" << std::endl;
+    out << "  --quiet      no console report, only records" << std::endl;
+}
+
+template <size_t N> int parse_token(const std::string& value, const char* const (&tokens)[N], const std::string& option)
+{
+    for (size_t i = 0; i < N; i++)
+    {
+        if (value == tokens[i])
+            return (int)i;
+    }
+
+    throw std::invalid_argument("Unknown value \"" + value + "\" for --" + option);
+}
+
+inline int parse_int(const std::string& value, const std::string& option, const int min)
+{
+    size_t end = 0;
+    long long v = 0;
+
+    try
+    {
+        v = std::stoll(value, &end);
+    }
+    catch (const std::exception&)
+    {
+        end = 0;
+    }
+
+    if (end == 0 || end != value.size() || v < min || v > INT32_MAX)
+        throw std::invalid_argument("Invalid value \"" + value + "\" for --" + option);
+
+    return (int)v;
+}
+
+inline double parse_double(const std::string& value, const std::string& option, const bool allow_negative = false)
+{
+    size_t end = 0;
+    double v = -1.0;
+
+    try
+    {
+        v = std::stod(value, &end);
+    }
+    catch (const std::exception&)
+    {
+        end = 0;
+    }
+
+    if (end == 0 || end != value.size() || !(allow_negative ? std::isfinite(v) : v >= 0.0))
+        throw std::invalid_argument("Invalid value \"" + value + "\" for --" + option);
+
+    return v;
+}
+
+inline std::vector<std::string> split_list(const std::string& value)
+{
+    std::vector<std::string> items;
+    std::stringstream s(value);
+    std::string item;
+
+    while (std::getline(s, item, ','))
+    {
+        const size_t begin = item.find_first_not_of(" \t");
+        const size_t end = item.find_last_not_of(" \t");
+
+        if (begin != std::string::npos)
+            items.push_back(item.substr(begin, end - begin + 1));
+    }
+
+    return items;
+}
+
+inline void load_config(const std::string& path, driver_options& options, vectorization_level detected);
+
+inline void set_option(const std::string& option, const std::string& value, driver_options& options, vectorization_level detected)
+{
+    const std::vector<std::string> items = split_list(value);
+
+    if (items.empty() && option != "program")
+        throw std::invalid_argument("Missing value for --" + option);
+
+    options.given.insert(option);
+
+    if (option == "bench")
+    {
+        options.benches.clear();
+        for (const auto& item : items)
+            options.benches.push_back((bench_type)parse_token(item, bench_tokens, option));
+    }
+    else if (option == "shape")
+    {
+        options.shapes.clear();
+        for (const auto& item : items)
+        {
+            if (item != "none")
+                options.shapes.push_back((graph_shape)parse_token(item, shape_tokens, option));
+        }
+    }
+    else if (option == "program")
+    {
+        // Taken whole, one expression per --program
+        options.programs.push_back(value);
+    }
+    else if (option == "vec")
+    {
+        options.vec_levels.clear();
+        for (const auto& item : items)
+        {
+            if (item == "auto")
+            {
+                options.vec_levels.push_back(detected);
+            }
+            else if (item == "all")
+            {
+                for (int l = 0; l <= (int)detected; l++)
+                    options.vec_levels.push_back((vectorization_level)l);
+            }
+            else
+            {
+                options.vec_levels.push_back((vectorization_level)parse_token(item, vec_level_tokens, option));
+            }
+        }
+    }
+    else if (option == "threads")
+    {
+        options.threads.clear();
+        for (const auto& item : items)
+        {
+            const int max_threads = std::thread::hardware_concurrency() > 0 ? (int)std::thread::hardware_concurrency() : 1;
+            options.threads.push_back(item == "max" ? max_threads : parse_int(item, option, 1));
+        }
+    }
+    else if (option == "placement")
+    {
+        options.placements.clear();
+        for (const auto& item : items)
+            options.placements.push_back((thread_placement)parse_token(item, placement_tokens, option));
+    }
+    else if (option == "size")
+    {
+        options.sizes.clear();
+        for (const auto& item : items)
+            options.sizes.push_back(parse_int(item, option, 1));
+    }
+    else if (option == "samples")
+    {
+        options.samples.clear();
+        for (const auto& item : items)
+            options.samples.push_back(parse_int(item, option, 1));
+    }
+    else if (option == "iterations")
+        options.max_iterations = parse_int(value, option, 1);
+    else if (option == "precision")
+    {
+        options.precisions.clear();
+        for (const auto& item : items)
+            options.precisions.push_back((precision_mode)parse_token(item, precision_tokens, option));
+    }
+    else if (option == "coverage")
+    {
+        options.coverages.clear();
+        for (const auto& item : items)
+            options.coverages.push_back((coverage_format)parse_token(item, coverage_tokens, option));
+    }
+    else if (option == "huge-pages")
+        options.huge_pages = (huge_page_mode)parse_token(value, huge_page_tokens, option);
+    else if (option == "zoom")
+    {
+        options.zoom = parse_double(value, option);
+
+        if (options.zoom <= 0.0)
+            throw std::invalid_argument("Invalid value \"" + value + "\" for --" + option);
+    }
+    else if (option == "center")
+    {
+        if (items.size() != 2)
+            throw std::invalid_argument("Invalid value \"" + value + "\" for --" + option);
+
+        options.center_x = parse_double(items[0], option, true);
+        options.center_y = parse_double(items[1], option, true);
+    }
+    else if (option == "path")
+    {
+        options.path.clear();
+        for (const auto& item : items)
+        {
+            std::vector<std::string> parts;
+            std::stringstream in(item);
+            std::string part;
+
+            while (std::getline(in, part, ':'))
+                parts.push_back(part);
+
+            if (parts.size() != 3)
+                throw std::invalid_argument("Invalid keyframe \"" + item + "\" for --" + option + ", expected zoom:x:y");
+
+            const view_keyframe key = { parse_double(parts[0], option), parse_double(parts[1], option, true), parse_double(parts[2], option, true) };
+
+            if (key.zoom <= 0.0)
+                throw std::invalid_argument("Invalid keyframe \"" + item + "\" for --" + option);
+
+            options.path.push_back(key);
+        }
+    }
+    else if (option == "frames")
+        options.frames = parse_int(value, option, 1);
+    else if (option == "frames-in-flight")
+        options.frames_in_flight = parse_int(value, option, 1);
+    else if (option == "tolerance")
+        options.tolerance = parse_double(value, option);
+    else if (option == "kernel")
+        options.kernel = (sampling_kernel)parse_token(value, kernel_tokens, option);
+    else if (option == "cull")
+        options.cull = (cull_mode)parse_token(value, cull_tokens, option);
+    else if (option == "grain")
+        options.grain = parse_int(value, option, 1);
+    else if (option == "loops")
+        options.loops = parse_int(value, option, 1);
+    else if (option == "warmup")
+        options.loop.warmup = parse_int(value, option, 0);
+    else if (option == "max-loops")
+        options.loop.max_runs = parse_int(value, option, 1);
+    else if (option == "ci")
+        options.loop.target_ci = parse_double(value, option);
+    else if (option == "outlier")
+        options.loop.outlier_k = parse_double(value, option);
+    else if (option == "statistic")
+        options.loop.statistic = (score_statistic)parse_token(value, statistic_tokens, option);
+    else if (option == "interval")
+        options.timeline_interval = parse_int(value, option, 0);
+    else if (option == "throttle")
+        options.throttle_threshold = parse_double(value, option);
+    else if (option == "time")
+        options.time = parse_int(value, option, 1);
+    else if (option == "format")
+        options.format = (record_format)parse_token(value, format_tokens, option);
+    else if (option == "output")
+        options.output = value;
+    else if (option == "image")
+        options.image = value;
+    else if (option == "image-format")
+        options.image_type = (image_format)parse_token(value, image_format_tokens, option);
+    else if (option == "tile")
+        options.tile_size = parse_int(value, option, 1);
+    else if (option == "tiles-in-flight")
+        options.tiles_in_flight = parse_int(value, option, 0);
+    else if (option == "profile")
+        options.profile = value;
+    else if (option == "config")
+        load_config(value, options, detected);
+    else
+        throw std::invalid_argument("Unknown option --" + option);
+}
+
+// Lines of "option = value" with the same names as the command line options
+inline void load_config(const std::string& path, driver_options& options, vectorization_level detected)
+{
+    std::ifstream in(path);
+
+    if (!in)
+        throw std::invalid_argument("Cannot open config file " + path);
+
+    std::string line;
+
+    while (std::getline(in, line))
+    {
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line = line.substr(0, comment);
+
+        const size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos)
+            continue;
+
+        const size_t split = line.find_first_of("= \t", begin);
+        const std::string option = line.substr(begin, split - begin);
+
+        std::string value;
+        if (split != std::string::npos)
+        {
+            const size_t value_begin = line.find_first_not_of("= \t", split);
+            const size_t value_end = line.find_last_not_of(" \t\r");
+
+            if (value_begin != std::string::npos)
+                value = line.substr(value_begin, value_end - value_begin + 1);
+        }
+
+        if (option == "quiet")
+            options.quiet = true;
+        else if (option == "scaling")
+            options.scaling = true;
+        else if (option == "compare-precision")
+            options.compare_precision = true;
+        else if (option == "counters")
+            options.counters = true;
+        else if (option == "no-symmetry")
+            options.no_symmetry = true;
+        else if (option == "no-graph-pool")
+            options.no_graph_pool = true;
+        else if (option == "progressive")
+            options.progressive = true;
+        else if (option == "batch")
+            options.batch = true;
+        else if (option == "tune")
+            options.tune = true;
+        else if (option == "no-profile")
+            options.no_profile = true;
+        else
+            set_option(option, value, options, detected);
+    }
+}
+
+// Options are applied in order, so values after --config override the file
+inline driver_options parse_driver_options(const int argc, char* argv[], vectorization_level detected)
+{
+    driver_options options;
+    options.vec_levels = { detected };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+
+        if (arg.compare(0, 2, "--") != 0)
+            throw std::invalid_argument("Unexpected argument " + arg);
+
+        const std::string option = arg.substr(2);
+
+        if (option == "quiet")
+        {
+            options.quiet = true;
+            continue;
+        }
+        if (option == "help")
+        {
+            options.help = true;
+            continue;
+        }
+        if (option == "scaling")
+        {
+            options.scaling = true;
+            continue;
+        }
+        if (option == "compare-precision")
+        {
+            options.compare_precision = true;
+            continue;
+        }
+        if (option == "counters")
+        {
+            options.counters = true;
+            continue;
+        }
+        if (option == "no-symmetry")
+        {
+            options.no_symmetry = true;
+            continue;
+        }
+        if (option == "no-graph-pool")
+        {
+            options.no_graph_pool = true;
+            continue;
+        }
+        if (option == "progressive")
+        {
+            options.progressive = true;
+            continue;
+        }
+        if (option == "batch")
+        {
+            options.batch = true;
+            continue;
+        }
+        if (option == "tune")
+        {
+            options.tune = true;
+            continue;
+        }
+        if (option == "no-profile")
+        {
+            options.no_profile = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+            throw std::invalid_argument("Missing value for " + arg);
+
+        set_option(option, argv[++i], options, detected);
+    }
+
+    if (options.scaling && options.compare_precision)
+        throw std::invalid_argument("--scaling and --compare-precision cannot be combined");
+
+    if (options.tune && (options.scaling || options.compare_precision))
+        throw std::invalid_argument("--tune cannot be combined with --scaling or --compare-precision");
+
+    if (options.batch)
+    {
+        if (options.tune || options.scaling || options.compare_precision)
+            throw std::invalid_argument("--batch cannot be combined with --tune, --scaling or --compare-precision");
+
+        for (const graph_shape shape : options.shapes)
+        {
+            if (!is_batch_shape(shape))
+                throw std::invalid_argument("--batch cannot hold escape-time shapes");
+        }
+
+        for (const precision_mode precision : options.precisions)
+        {
+            if (precision != precision_mode::SINGLE)
+                throw std::invalid_argument("--batch runs in single precision only");
+        }
+
+        if (options.shapes.empty() || !options.programs.empty())
+            throw std::invalid_argument("--batch runs built-in shapes only");
+    }
+
+    if (!options.path.empty())
+    {
+        if (options.batch || options.tune || options.scaling || options.compare_precision)
+            throw std::invalid_argument("--path cannot be combined with --batch, --tune, --scaling or --compare-precision");
+
+        if (options.progressive || !options.image.empty())
+            throw std::invalid_argument("--path renders frames in memory, without --progressive or --image");
+    }
+
+    return options;
+}
+
+// Replaces params with a shape's tuned settings where the option was not given. Scaling sweeps keep
+// their thread counts and levels the CPU does not support are ignored.
+inline void apply_tuned_settings(run_params& params, const tuned_settings& tuned, const driver_options& options, vectorization_level detected)
+{
+    if (options.given.count("vec") == 0 && tuned.vec_level <= detected)
+        params.vec_level = tuned.vec_level;
+
+    if (options.given.count("kernel") == 0)
+    {
+        params.kernel = tuned.kernel;
+        params.accumulators = tuned.accumulators;
+    }
+
+    if (options.given.count("threads") == 0 && !options.scaling)
+        params.threads = tuned.threads;
+
+    if (options.given.count("grain") == 0)
+        params.grain = tuned.grain;
+}
+
+// Tunes every built-in shape at the first size, samples, precision and coverage of the options and
+// saves the profile after each shape, returns the process exit code
+inline int run_tune(const driver_options& options, const host_info& host, result_writer& writer, const bool verbose)
+{
+    const vectorization_level detected = host.detected_level;
+
+    vectorization_level max_level = detected;
+    if (options.given.count("vec") != 0)
+    {
+        max_level = vectorization_level::NONE;
+        for (const vectorization_level l : options.vec_levels)
+            max_level = l > max_level && l <= detected ? l : max_level;
+    }
+
+    int max_threads = std::thread::hardware_concurrency() > 0 ? (int)std::thread::hardware_concurrency() : 1;
+    if (options.given.count("threads") != 0)
+    {
+        max_threads = 1;
+        for (const int t : options.threads)
+            max_threads = t > max_threads ? t : max_threads;
+    }
+
+    if (!options.programs.empty())
+        std::cerr << "Programs are not tuned, only built-in shapes" << std::endl;
+
+    tuning_profile profile = load_profile(options.profile, host.cpu_model);
+
+    for (size_t s = 0; s < options.shapes.size(); s++)
+    {
+        const graph_shape shape = options.shapes[s];
+
+        run_params params(shape, max_level, options.samples.front(), options.sizes.front(), 1, options.kernel, options.cull, options.grain);
+        params.precision = options.precisions.front();
+        params.coverage = options.coverages.front();
+        params.huge_pages = options.huge_pages;
+        params.graph_pool = !options.no_graph_pool;
+        params.max_iterations = options.max_iterations;
+        params.zoom = options.zoom;
+        params.center_x = options.center_x;
+        params.center_y = options.center_y;
+        params.loop = options.loop;
+        params.verbose = verbose;
+
+        // Tuned settings are applied to any view, so candidates are timed on every unit
+        params.symmetry = false;
+
+        std::cerr << "[" << s + 1 << "/" << options.shapes.size() << "] tune " << shape_tokens[(int)shape] << " up to "
+            << vec_level_tokens[(int)max_level] << " threads=" << max_threads << " size=" << params.size << " samples=" << params.samples << std::endl;
+
+        std::vector<std::pair<tuned_settings, score_summary>> candidates;
+
+        const tuned_settings best = run_tuning(params, options.loops, max_level, max_threads, [&](const tuned_settings& settings, const score_summary& summary)
+        {
+            candidates.push_back({ settings, summary });
+        });
+
+        profile.set(best);
+
+        if (!save_profile(options.profile, profile))
+        {
+            std::cerr << "Cannot write tuning profile " << options.profile << std::endl;
+            return 1;
+        }
+
+        for (const auto& [settings, summary] : candidates)
+        {
+            run_params p = params;
+            p.vec_level = settings.vec_level;
+            p.kernel = settings.kernel;
+            p.accumulators = settings.accumulators;
+            p.threads = settings.threads;
+            p.grain = settings.grain;
+
+            const bool is_best = settings.vec_level == best.vec_level && settings.kernel == best.kernel && settings.accumulators == best.accumulators
+                && settings.threads == best.threads && settings.grain == best.grain;
+
+            writer.write(make_tuning_record(host, p, shape_tokens[(int)shape], summary, is_best));
+        }
+    }
+
+    std::cerr << "Tuning profile of " << host.cpu_model << " saved to " << options.profile << std::endl;
+
+    return 0;
+}
+
+// Runs the built-in shapes of every other combination as one batch, one record per shape and run
+inline int run_batch_matrix(const driver_options& options, const host_info& host, result_writer& writer, const bool verbose)
+{
+    const std::vector<thread_placement> placements = options.placements.empty() ? std::vector<thread_placement>{ thread_placement::NONE } : options.placements;
+
+    const long long total = (long long)options.vec_levels.size() * options.coverages.size() * options.threads.size() * placements.size()
+        * options.sizes.size() * options.samples.size();
+
+    long long index = 0;
+
+    for (const vectorization_level vec_level : options.vec_levels)
+    for (const coverage_format coverage : options.coverages)
+    for (const int threads : options.threads)
+    for (const thread_placement placement : placements)
+    for (const int size : options.sizes)
+    for (const int samples : options.samples)
+    {
+        index++;
+
+        run_params params(options.shapes.front(), vec_level, samples, size, threads, sampling_kernel::ROW_SWEEP, cull_mode::NONE, options.grain);
+        params.placement = placement;
+        params.coverage = coverage;
+        params.huge_pages = options.huge_pages;
+        params.graph_pool = !options.no_graph_pool;
+        params.zoom = options.zoom;
+        params.center_x = options.center_x;
+        params.center_y = options.center_y;
+        params.loop = options.loop;
+        params.symmetry = false;
+        params.verbose = verbose;
+
+        std::cerr << "[" << index << "/" << total << "] batch " << options.shapes.size() << " shapes " << vec_level_tokens[(int)vec_level]
+            << " coverage=" << coverage_tokens[(int)coverage] << " threads=" << threads << " placement=" << placement_tokens[(int)placement]
+            << " size=" << size << " samples=" << samples << std::endl;
+
+        if (vec_level > host.detected_level)
+        {
+            std::cerr << "Skipped: " << vec_level_to_string(vec_level) << " not supported by this CPU" << std::endl;
+            continue;
+        }
+
+        std::vector<batch_run_result> results;
+        const score_summary summary = run_batch_loop(params, options.shapes, options.loops, [&](int, const batch_run_result& result)
+        {
+            results.push_back(result);
+        });
+
+        for (int run = 0; run < summary.runs(); run++)
+        {
+            for (const auto& shape_result : results[run].shapes)
+            {
+                run_params shape_params = params;
+                shape_params.shape = shape_result.shape;
+
+                result_record record = make_batch_record(host, shape_params, shape_tokens[(int)shape_result.shape], run, summary.runs(),
+                    results[run], shape_result);
+
+                add_summary_fields(record, summary, run);
+                writer.write(record);
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Renders the path for every combination of shapes, vec levels, precisions, coverages, threads,
+// placements, sizes and samples, one record per run
+inline int run_animation_matrix(const driver_options& options, const std::vector<shape_program>& programs, const tuning_profile& profile,
+    const host_info& host, result_writer& writer, const bool verbose)
+{
+    const std::vector<thread_placement> placements = options.placements.empty() ? std::vector<thread_placement>{ thread_placement::NONE } : options.placements;
+    const int shape_count = (int)options.shapes.size() + (int)programs.size();
+
+    const long long total = (long long)shape_count * options.vec_levels.size() * options.precisions.size() * options.coverages.size()
+        * options.threads.size() * placements.size() * options.sizes.size() * options.samples.size();
+
+    long long index = 0;
+
+    for (int s = 0; s < shape_count; s++)
+    for (const vectorization_level vec_level : options.vec_levels)
+    for (const precision_mode precision : options.precisions)
+    for (const coverage_format coverage : options.coverages)
+    for (const int threads : options.threads)
+    for (const thread_placement placement : placements)
+    for (const int size : options.sizes)
+    for (const int samples : options.samples)
+    {
+        index++;
+
+        const bool is_program = s >= (int)options.shapes.size();
+        const graph_shape shape = is_program ? graph_shape::EMPTY : options.shapes[s];
+
+        run_params params(shape, vec_level, samples, size, threads, options.kernel, options.cull, options.grain);
+        params.placement = placement;
+        params.precision = precision;
+        params.coverage = coverage;
+        params.huge_pages = options.huge_pages;
+        params.graph_pool = !options.no_graph_pool;
+        params.max_iterations = options.max_iterations;
+        params.zoom = options.path.front().zoom;
+        params.center_x = options.path.front().center_x;
+        params.center_y = options.path.front().center_y;
+        params.loop = options.loop;
+        params.counters = options.counters;
+        params.symmetry = false;
+        params.verbose = verbose;
+
+        if (is_program)
+            params.program = &programs[s - options.shapes.size()];
+        else if (const tuned_settings* tuned = profile.find(shape))
+            apply_tuned_settings(params, *tuned, options, host.detected_level);
+
+        const std::string name = is_program ? params.program->source : shape_tokens[(int)shape];
+
+        std::cerr << "[" << index << "/" << total << "] animation " << name << " " << vec_level_tokens[(int)params.vec_level]
+            << " precision=" << precision_tokens[(int)precision] << " coverage=" << coverage_tokens[(int)coverage]
+            << " threads=" << params.threads << " placement=" << placement_tokens[(int)placement]
+            << " size=" << size << " samples=" << samples << " frames=" << options.frames << std::endl;
+
+        if (params.vec_level > host.detected_level)
+        {
+            std::cerr << "Skipped: " << vec_level_to_string(params.vec_level) << " not supported by this CPU" << std::endl;
+            continue;
+        }
+
+        std::vector<animation_run_result> results;
+        const score_summary summary = run_animation_loop(params, options.path, options.frames, options.frames_in_flight, options.loops,
+            [&](int, const animation_run_result& result)
+        {
+            results.push_back(result);
+        });
+
+        for (int run = 0; run < summary.runs(); run++)
+        {
+            result_record record = make_animation_record(host, params, name, options.path, run, summary.runs(), results[run]);
+
+            add_summary_fields(record, summary, run);
+            writer.write(record);
+        }
+    }
+
+    return 0;
+}
+
+// Runs the benchmark matrix, or the animation matrix when a path is set
+inline int run_benchmark_matrix(const driver_options& options, const std::vector<shape_program>& programs, const host_info& host,
+    result_writer& writer, const bool verbose)
+{
+    const vectorization_level detected = host.detected_level;
+
+    const tuning_profile profile = options.no_profile ? tuning_profile() : load_profile(options.profile, host.cpu_model);
+
+    if (!profile.entries.empty())
+        std::cerr << "Tuning profile: " << profile.entries.size() << " shapes of " << host.cpu_model << " from " << options.profile << std::endl;
+
+    if (!options.path.empty())
+        return run_animation_matrix(options, programs, profile, host, writer, verbose);
+
+    // Built-in shapes first, then programs by index
+    const int shape_count = (int)options.shapes.size() + (int)programs.size();
+
+    // A scaling sweep replaces the thread list with one sweep per combination
+    const std::vector<int> thread_counts = options.scaling ? std::vector<int>{ 0 } : options.threads;
+
+    std::vector<thread_placement> placements = options.placements;
+    if (placements.empty())
+    {
+        if (options.scaling)
+            placements = { thread_placement::SMT_ON, thread_placement::SMT_OFF };
+        else
+            placements = { thread_placement::NONE };
+    }
+
+    const std::vector<thread_placement> matrix_placements = options.scaling ? std::vector<thread_placement>{ thread_placement::NONE } : placements;
+
+    // A precision comparison runs every precision for each combination
+    const std::vector<precision_mode> precisions = options.compare_precision ? std::vector<precision_mode>{ precision_mode::SINGLE } : options.precisions;
+
+    const long long total = (long long)options.benches.size() * shape_count * options.vec_levels.size() * precisions.size()
+        * options.coverages.size() * thread_counts.size() * matrix_placements.size() * options.sizes.size() * options.samples.size();
+
+    long long index = 0;
+
+    for (const bench_type bench : options.benches)
+    for (int s = 0; s < shape_count; s++)
+    for (const vectorization_level vec_level : options.vec_levels)
+    for (const precision_mode precision : precisions)
+    for (const coverage_format coverage : options.coverages)
+    for (const int threads : thread_counts)
+    for (const thread_placement placement : matrix_placements)
+    for (const int size : options.sizes)
+    for (const int samples : options.samples)
+    {
+        index++;
+
+        const bool is_program = s >= (int)options.shapes.size();
+        const graph_shape shape = is_program ? graph_shape::EMPTY : options.shapes[s];
+
+        run_params params(shape, vec_level, samples, size, threads, options.kernel, options.cull, options.grain);
+        params.placement = placement;
+        params.precision = precision;
+        params.coverage = coverage;
+        params.huge_pages = options.huge_pages;
+        params.graph_pool = !options.no_graph_pool;
+        params.max_iterations = options.max_iterations;
+        params.zoom = options.zoom;
+        params.center_x = options.center_x;
+        params.center_y = options.center_y;
+        params.loop = options.loop;
+        params.timeline_interval = options.timeline_interval;
+        params.throttle_threshold = options.throttle_threshold;
+        params.counters = options.counters;
+        params.symmetry = !options.no_symmetry;
+        params.progressive = options.progressive;
+        params.verbose = verbose;
+        params.image_path = options.image;
+        params.image = options.image_type;
+        params.tile_size = options.tile_size;
+        params.tiles_in_flight = options.tiles_in_flight;
+
+        if (is_program)
+            params.program = &programs[s - options.shapes.size()];
+        else if (const tuned_settings* tuned = profile.find(shape))
+            apply_tuned_settings(params, *tuned, options, detected);
+
+        const std::string name = is_program ? params.program->source : shape_tokens[(int)shape];
+        const std::string bench_name = bench_tokens[(int)bench];
+        const long long time = bench == bench_type::FIXED_TIME ? options.time : 0;
+
+        std::cerr << "[" << index << "/" << total << "] " << bench_name << " " << name << " " << vec_level_tokens[(int)params.vec_level];
+        std::cerr << " precision=" << (options.compare_precision ? "compare" : precision_tokens[(int)precision]);
+        std::cerr << " coverage=" << coverage_tokens[(int)coverage];
+
+        if (options.scaling)
+            std::cerr << " threads=scaling";
+        else
+            std::cerr << " threads=" << params.threads << " placement=" << placement_tokens[(int)placement];
+
+        std::cerr << " size=" << size << " samples=" << samples << std::endl;
+
+        if (params.vec_level > detected)
+        {
+            std::cerr << "Skipped: " << vec_level_to_string(params.vec_level) << " not supported by this CPU" << std::endl;
+            continue;
+        }
+
+        if (options.scaling)
+        {
+            const auto curves = run_scaling_sweep(params, bench, options.time, options.loops, placements);
+
+            for (const auto& curve : curves)
+            {
+                for (const auto& point : curve.points)
+                {
+                    run_params point_params = params;
+                    point_params.threads = point.threads;
+                    point_params.placement = curve.placement;
+
+                    writer.write(make_scaling_record(host, point_params, bench_name, name, time, point, curve));
+                }
+            }
+        }
+        else if (options.compare_precision)
+        {
+            for (const auto& point : run_precision_sweep(params, bench, options.time, options.loops, options.tolerance))
+            {
+                run_params point_params = params;
+                point_params.precision = point.precision;
+
+                writer.write(make_precision_record(host, point_params, bench_name, name, time, point));
+            }
+        }
+        else
+        {
+            // Records wait for the loop summary, which marks outliers and the number of runs
+            std::vector<multisample_run_result> multisample_results;
+            std::vector<fixedtime_run_result> fixedtime_results;
+            score_summary summary;
+
+            if (bench == bench_type::MULTISAMPLE)
+            {
+                summary = run_multisample_loop(params, options.loops, [&](int, const multisample_run_result& result)
+                {
+                    multisample_results.push_back(result);
+                });
+            }
+            else
+            {
+                summary = run_fixedtime_loop(params, options.time, options.loops, [&](int, const fixedtime_run_result& result)
+                {
+                    fixedtime_results.push_back(result);
+                });
+            }
+
+            for (int run = 0; run < summary.runs(); run++)
+            {
+                result_record record = bench == bench_type::MULTISAMPLE
+                    ? make_multisample_record(host, params, name, run, summary.runs(), multisample_results[run])
+                    : make_fixedtime_record(host, params, name, options.time, run, summary.runs(), fixedtime_results[run]);
+
+                add_summary_fields(record, summary, run);
+                writer.write(record);
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Runs the whole matrix, returns the process exit code
+inline int run_driver(const int argc, char* argv[])
+{
+    const vectorization_level detected = detect_vec_level();
+
+    driver_options options;
+    std::vector<shape_program> programs;
+
+    try
+    {
+        options = parse_driver_options(argc, argv, detected);
+
+        for (const auto& source : options.programs)
+            programs.push_back(compile_shape(source));
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cerr << e.what() << std::endl << std::endl;
+        print_driver_usage(std::cerr);
+        return 1;
+    }
+
+    if (options.help)
+    {
+        print_driver_usage(std::cout);
+        return 0;
+    }
+
+    std::ofstream file;
+    std::string existing;
+
+    if (!options.output.empty())
+    {
+        // Records are appended, the first line tells the writer what the file already holds
+        std::ifstream previous(options.output);
+        std::getline(previous, existing);
+
+        file.open(options.output, std::ios::out | std::ios::app);
+
+        if (!file)
+        {
+            std::cerr << "Cannot open output file " << options.output << std::endl;
+            return 1;
+        }
+    }
+
+    // Records on stdout would be mixed with the console report
+    std::ostream& record_out = options.output.empty() ? std::cout : file;
+    const bool verbose = !options.quiet && !options.output.empty();
+
+    result_writer writer(record_out, options.format, existing);
+    const host_info host = get_host_info(detected);
+
+    try
+    {
+        if (options.tune)
+            return run_tune(options, host, writer, verbose);
+
+        if (options.batch)
+            return run_batch_matrix(options, host, writer, verbose);
+
+        return run_benchmark_matrix(options, programs, host, writer, verbose);
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
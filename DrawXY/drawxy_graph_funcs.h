@@ -1,13 +1,20 @@
 #pragma once
 
 #include "drawxy_common.h"
-#include "drawxy_draw_funcs.h"
 #include "drawxy_structs.h"
+#include "drawxy_coverage.h"
+
+#include "drawxy_thread_pool.h"
+#include "drawxy_tiles.h"
 
 #include <chrono>
 #include <thread>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <vector>
+#include <algorithm>
+#include <functional>
 
 enum class bench_type
 {
@@ -15,360 +22,1043 @@ enum class bench_type
     FIXED_TIME
 };
 
-template <typename T> const std::vector<float> graph_single(const T(*func)(T, T), const int size, const float scale_x, const float scale_y,
-    const float offset_x, const float offset_y);
-
-template <> const std::vector<float> graph_single<float>(const float(*func)(float, float), const int size, const float scale_x, const float scale_y,
-    const float offset_x, const float offset_y)
+// Units are stored in the graph's coverage format
+inline const multisample_run_result graph_multisample_direct(const unit_kernel calc, int size, int samples,
+    double scale_x, double scale_y, double offset_x, double offset_y, coverage_buffer& graph)
 {
-    const int size2 = size * size;
+    multisample_run_result result;
+    graph.resize((long long)size * size);
+
+    long long best_single_time = INT64_MAX;
+    long long sum_single_time = 0;
 
-    std::vector<float> result(size2);
+    const double scale_x_p = scale_x / size;
+    const double scale_y_p = scale_y / size;
 
-    for (int i = 0; i < size2; i++)
+    auto begin_time = std::chrono::steady_clock::now();
+
+    for (int y = 0; y < size; y++)
     {
-        // Calculate coordinates from index
-        const int cx = i % size;
-        const int cy = i / size;
+        for (int x = 0; x < size; x++)
+        {
+            auto begin_time_inner = std::chrono::steady_clock::now();
+
+            const double offset_x_p = offset_x + x * scale_x_p;
+            const double offset_y_p = offset_y + y * scale_y_p;
+
+            graph.store(x + (long long)y * size, calc(samples, scale_x_p, scale_y_p, offset_x_p, offset_y_p));
 
-        const float x = (float)cx / size * scale_x + offset_x;
-        const float y = (float)cy / size * scale_y + offset_y;
+            auto end_time_inner = std::chrono::steady_clock::now();
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time_inner - begin_time_inner).count();
 
-        result[i] = func(x, y);
+            sum_single_time += duration;
+            if (best_single_time > duration)
+                best_single_time = duration;
+        }
     }
 
+    auto end_time = std::chrono::steady_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - begin_time).count();
+
+    result.sum_single_time = sum_single_time;
+    result.best_single_time = best_single_time;
+    result.total_time = duration;
+
     return result;
 }
 
-template <> const std::vector<float> graph_single<Vec8f>(const Vec8f(*func)(Vec8f, Vec8f), const int size, const float scale_x, const float scale_y,
-    const float offset_x, const float offset_y)
+// Units per chunk when copying mirrored units
+constexpr long long mirror_grain = 4096;
+
+// Symmetries of a shape that map the view's units onto each other exactly. The diagonal swaps x and
+// y sample for sample and needs equal offsets and scales. Mirrors need the view centered on their
+// axis, and since samples sit at the low edge of their step a mirrored unit's samples land one step
+// off the mirror image of its representative's. Only the integer lattice corrects that exactly, so
+// mirrors are kept for lattice renders only.
+inline symmetry_group view_symmetry(const symmetry_group shape, double scale_x, double scale_y, double offset_x, double offset_y,
+    bool lattice)
 {
-    static constexpr int group_size = 8;
+    const bool centered_x = offset_x == -scale_x / 2;
+    const bool centered_y = offset_y == -scale_y / 2;
 
-    const int size2 = size * size;
+    symmetry_group view;
+    view.mirror_x = lattice && shape.mirror_x && centered_x;
+    view.mirror_y = lattice && shape.mirror_y && centered_y;
+    view.diagonal = shape.diagonal && offset_x == offset_y && scale_x == scale_y;
+    view.point = lattice && (shape.point || (shape.mirror_x && shape.mirror_y)) && centered_x && centered_y;
 
-    const Vec8f size_v(size);
-    const Vec8f scale_x_v(scale_x);
-    const Vec8f scale_y_v(scale_y);
-    const Vec8f offset_x_v(offset_x);
-    const Vec8f offset_y_v(offset_y);
+    return view;
+}
 
-    const Vec8f scale_x_o_size_v = scale_x_v / size_v;
-    const Vec8f scale_y_o_size_v = scale_y_v / size_v;
+// b after a
+inline unit_transform compose_transforms(const unit_transform& a, const unit_transform& b)
+{
+    unit_transform c;
+    c.swap = a.swap != b.swap;
+    c.flip_x = b.flip_x != (b.swap ? a.flip_y : a.flip_x);
+    c.flip_y = b.flip_y != (b.swap ? a.flip_x : a.flip_y);
 
-    std::vector<float> result(size2);
+    return c;
+}
 
-    for (int i = 0; i < size2; i += group_size)
-    {
-        Vec8f i_v(i);
-        i_v += ci_v8;
+// Transforms of the group a symmetry generates, the identity first, at most 8
+inline int symmetry_transforms(const symmetry_group& symmetry, unit_transform (&transforms)[8])
+{
+    const unit_transform generators[4] = { { false, true, false }, { false, false, true }, { true, false, false }, { false, true, true } };
+    const bool applies[4] = { symmetry.mirror_x, symmetry.mirror_y, symmetry.diagonal, symmetry.point };
 
-        // x vector
-        // cx = i % size = i - roundto0(i / size) * size
-        // x = cx / size * scale_x + offset_x
-        Vec8f x_v = i_v;
+    transforms[0] = unit_transform();
+    int n = 1;
 
-        x_v = x_v / size_v;
-        x_v = truncate(x_v);
-        x_v = nmul_add(x_v, size_v, i_v);
+    for (int i = 0; i < n; i++)
+    {
+        for (int g = 0; g < 4; g++)
+        {
+            if (!applies[g])
+                continue;
 
-        x_v = mul_add(x_v, scale_x_o_size_v, offset_x_v);
+            const unit_transform c = compose_transforms(transforms[i], generators[g]);
 
-        // y vector
-        // cy = i / size
-        // y = cy / size * scale_y + offset_y
-        Vec8f y_v = i_v;
+            bool seen = false;
+            for (int j = 0; j < n; j++)
+                seen = seen || (transforms[j].swap == c.swap && transforms[j].flip_x == c.flip_x && transforms[j].flip_y == c.flip_y);
 
-        y_v = y_v / size_v;
+            if (!seen)
+                transforms[n++] = c;
+        }
+    }
 
-        y_v = mul_add(y_v, scale_y_o_size_v, offset_y_v);
+    return n;
+}
 
-        // Result
-        Vec8f r_v = func(x_v, y_v);
+inline long long transform_unit(const unit_transform& transform, int size, int x, int y)
+{
+    if (transform.swap)
+        std::swap(x, y);
+    if (transform.flip_x)
+        x = size - 1 - x;
+    if (transform.flip_y)
+        y = size - 1 - y;
+
+    return x + (long long)y * size;
+}
 
-        r_v.store(&result[i]);
-    }
+// Smallest unit index in the orbit of unit (x, y)
+inline long long symmetry_representative(const unit_transform* transforms, int count, int size, int x, int y)
+{
+    long long best = x + (long long)y * size;
 
-    return result;
+    for (int g = 1; g < count; g++)
+        best = std::min(best, transform_unit(transforms[g], size, x, y));
+
+    return best;
 }
 
-template <graph_shape shape> const float calc_avg_s(const int samples, const float scale_x, const float scale_y,
-    const float offset_x, const float offset_y)
+// Opens a worker's counters on its first unit, on the worker's own thread. A failed open is not retried.
+inline void open_worker_events(std::vector<perf_events>& events, int worker)
 {
-    const int samples2 = samples * samples;
+    perf_events& ev = events[worker];
 
-    float avg = 0.0f;
+    if (!ev.is_open() && ev.error.empty())
+        ev.open();
+}
 
-    for (int i = 0; i < samples2; i++)
+// Sums the workers' counts, stats receives each worker's own counts when given
+inline void collect_worker_events(const std::vector<perf_events>& events, perf_counts& counters, std::string& error,
+    std::vector<thread_stats>* stats = nullptr)
+{
+    for (size_t w = 0; w < events.size(); w++)
     {
-        // Calculate coordinates from index
-        const int cx = i % samples;
-        const int cy = i / samples;
+        const perf_counts counts = events[w].read();
 
-        const float x = (float)cx / samples * scale_x + offset_x;
-        const float y = (float)cy / samples * scale_y + offset_y;
+        if (stats != nullptr)
+            (*stats)[w].counters = counts;
 
-        avg += draw_func<float, shape>(x, y);
+        counters.merge(counts);
+
+        if (error.empty())
+            error = events[w].error;
     }
+}
 
-    return avg / samples2;
+// Classifies a unit when classify is set, counting culled units. Boundary without classify.
+inline unit_class cull_unit(const classify_func classify, double scale_x_p, double scale_y_p, double offset_x_p, double offset_y_p,
+    thread_stats& ts)
+{
+    if (classify == nullptr)
+        return unit_class::BOUNDARY;
+
+    const unit_class c = classify(scale_x_p, scale_y_p, offset_x_p, offset_y_p);
+
+    ts.inside_units += c == unit_class::INSIDE;
+    ts.outside_units += c == unit_class::OUTSIDE;
+
+    return c;
 }
 
-template <graph_shape shape> const float calc_avg_v8(const int samples, const float scale_x, const float scale_y,
-    const float offset_x, const float offset_y)
+// One kernel call taking duration, bracketed by the worker's hardware counters when ev is set
+inline float time_unit(const unit_kernel& calc, int samples, double scale_x_p, double scale_y_p,
+    double offset_x_p, double offset_y_p, perf_events* ev, long long& duration)
 {
-    static constexpr int group_size = 8;
+    if (ev != nullptr)
+        ev->start();
 
-    const int samples2 = samples * samples;
+    auto begin_time = std::chrono::steady_clock::now();
 
-    const Vec8f size_v(samples);
-    const Vec8f scale_x_v(scale_x);
-    const Vec8f scale_y_v(scale_y);
-    const Vec8f offset_x_v(offset_x);
-    const Vec8f offset_y_v(offset_y);
+    const float value = calc(samples, scale_x_p, scale_y_p, offset_x_p, offset_y_p);
 
-    const Vec8f scale_x_o_size_v = scale_x_v / size_v;
-    const Vec8f scale_y_o_size_v = scale_y_v / size_v;
+    auto end_time = std::chrono::steady_clock::now();
+    duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - begin_time).count();
 
-    float avg = 0.0f;
-    Vec8f sum_v(0);
+    if (ev != nullptr)
+        ev->stop();
 
-#pragma clang loop unroll(disable)
-    for (int i = 0; i < samples2; i += group_size)
-    {
-        Vec8f i_v(i);
-        i_v += ci_v8;
+    return value;
+}
 
-        // x vector
-        // cx = i % size = i - roundto0(i / size) * size
-        // x = cx / size * scale_x + offset_x
-        Vec8f x_v = i_v;
+// One timed kernel call recorded as the unit's latency
+inline float sample_unit(const unit_kernel& calc, int samples, double scale_x_p, double scale_y_p,
+    double offset_x_p, double offset_y_p, thread_stats& ts, perf_events* ev)
+{
+    long long duration = 0;
+    const float value = time_unit(calc, samples, scale_x_p, scale_y_p, offset_x_p, offset_y_p, ev, duration);
 
-        // y vector
-        // cy = i / size
-        // y = cy / size * scale_y + offset_y
-        Vec8f y_v = i_v;
+    ts.unit_latency.record(duration);
 
-        x_v /= size_v;
-        y_v /= size_v;
+    return value;
+}
 
-        x_v = truncate(x_v);
-        x_v = nmul_add(x_v, size_v, i_v);
+// One unit of a multisample run. Units are classified first when classify is set, only boundary units
+// are sampled.
+inline float run_unit(const unit_kernel& calc, const classify_func classify, int samples, double scale_x_p, double scale_y_p,
+    double offset_x_p, double offset_y_p, thread_stats& ts, perf_events* ev)
+{
+    ts.units++;
 
-        x_v = mul_add(x_v, scale_x_o_size_v, offset_x_v);
-        
-        y_v = mul_add(y_v, scale_y_o_size_v, offset_y_v);
+    const unit_class c = cull_unit(classify, scale_x_p, scale_y_p, offset_x_p, offset_y_p, ts);
 
-        // Result
-        Vec8f r_v = draw_func<Vec8f, shape>(x_v, y_v);
-        sum_v += r_v;
-    }
+    if (c != unit_class::BOUNDARY)
+        return c == unit_class::INSIDE ? 1.0f : 0.0f;
 
-    avg = horizontal_add(sum_v) / samples2;
-    return avg;
+    return sample_unit(calc, samples, scale_x_p, scale_y_p, offset_x_p, offset_y_p, ts, ev);
 }
 
-template <vectorization_level vl, graph_shape shape> constexpr float calc_avg(const int samples, const float scale_x, const float scale_y,
-    const float offset_x, const float offset_y)
+// Merges per-worker stats and counters into a run result
+inline void collect_worker_stats(multisample_run_result& result, std::vector<thread_stats>& stats, const std::vector<perf_events>& events)
 {
-    if constexpr (vl == vectorization_level::NONE)
+    for (const thread_stats& ts : stats)
     {
-        return calc_avg_s<shape>(samples, scale_x, scale_y, offset_x, offset_y);
-    }
-    else if constexpr (vl == vectorization_level::AVX2)
-    {
-        return calc_avg_v8<shape>(samples, scale_x, scale_y, offset_x, offset_y);
+        result.unit_latency.merge(ts.unit_latency);
+        result.inside_units += ts.inside_units;
+        result.outside_units += ts.outside_units;
     }
+
+    collect_worker_events(events, result.counters, result.counter_error, &stats);
+
+    result.sum_single_time = result.unit_latency.sum;
+    result.best_single_time = result.unit_latency.min;
+    result.per_thread = std::move(stats);
 }
 
-template <typename T, graph_shape shape> const multisample_run_result graph_multisample_direct( int size, int samples,
-    float scale_x, float scale_y, float offset_x, float offset_y)
+// Units are stored in the graph's coverage format. With a view symmetry only the smallest unit of
+// each orbit is scheduled, and its worker stores the other units of the orbit: diagonal images are
+// copies, axis images are corrected on the lattice by lattice_mirror, and images culled on their own,
+// too far off the lattice or of a culled representative are computed. Diagonal copies only match a
+// direct evaluation when the kernel treats x and y alike. With count_events each kernel call is
+// bracketed by the calling worker's hardware counters.
+inline const multisample_run_result graph_multisample_mt(const unit_kernel calc, const classify_func classify, int size, int samples,
+    double scale_x, double scale_y, double offset_x, double offset_y, int threads, int grain, coverage_buffer& graph,
+    const symmetry_group symmetry = symmetry_group(), bool count_events = false, const lattice_mirror_func lattice_mirror = nullptr)
 {
-    const float size2 = size * size;
+    const int size2 = size * size;
+    
+    multisample_run_result result;
+    result.memory = graph.resize(size2, threads);
 
-    multisample_graph_result result;
-    result.graph = std::vector<float>(size2);
+    std::vector<thread_stats> stats(threads);
+    std::vector<perf_events> events(count_events ? threads : 0);
 
-    long long best_single_time = INT64_MAX;
-    long long sum_single_time = 0;
+    const double scale_x_p = scale_x / size;
+    const double scale_y_p = scale_y / size;
 
-    float scale_x_p = scale_x / size;
-    float scale_y_p = scale_y / size;
+    const long long samples2 = (long long)samples * samples;
 
-    auto begin_time = std::chrono::steady_clock::now();
+    unit_transform transforms[8];
+    const int transform_count = symmetry_transforms(symmetry, transforms);
+    const bool symmetric = transform_count > 1;
 
-    for (int y = 0; y < size; y++)
+    // Units computed when the view is symmetric, one per orbit, and the images each worker mirrored
+    std::vector<long long> units;
+    std::vector<long long> mirrored(threads);
+
+    const thread_pool::chunk_func run_calc = [&](int worker, long long begin, long long end)
     {
-        for (int x = 0; x < size; x++)
+        thread_stats& ts = stats[worker];
+        perf_events* ev = nullptr;
+
+        if (count_events)
         {
-            auto begin_time_inner = std::chrono::steady_clock::now();
+            open_worker_events(events, worker);
+            ev = &events[worker];
+        }
+
+        auto chunk_begin_time = std::chrono::steady_clock::now();
 
-            float offset_x_p = offset_x + x * scale_x_p;
-            float offset_y_p = offset_y + y * scale_y_p;
+        for (long long u = begin; u < end; u++)
+        {
+            const long long i = symmetric ? units[u] : u;
 
-            result.graph[x + y * size] = calc_avg<T, shape>(samples, scale_x_p, scale_y_p, offset_x_p, offset_y_p);
+            int x = i % size;
+            int y = i / size;
 
-            auto end_time_inner = std::chrono::steady_clock::now();
-            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time_inner - begin_time_inner).count();
+            const double offset_x_p = offset_x + x * scale_x_p;
+            const double offset_y_p = offset_y + y * scale_y_p;
 
-            sum_single_time += duration;
-            if (best_single_time > duration)
-                best_single_time = duration;
+            if (!symmetric)
+            {
+                graph.store(i, run_unit(calc, classify, samples, scale_x_p, scale_y_p, offset_x_p, offset_y_p, ts, ev));
+                continue;
+            }
+
+            ts.units++;
+
+            const unit_class c = cull_unit(classify, scale_x_p, scale_y_p, offset_x_p, offset_y_p, ts);
+            const bool sampled = c == unit_class::BOUNDARY;
+            const float value = sampled ? sample_unit(calc, samples, scale_x_p, scale_y_p, offset_x_p, offset_y_p, ts, ev)
+                : (c == unit_class::INSIDE ? 1.0f : 0.0f);
+
+            graph.store(i, value);
+
+            long long images[8] = { i };
+            int image_count = 1;
+
+            for (int g = 1; g < transform_count; g++)
+            {
+                const long long m = transform_unit(transforms[g], size, x, y);
+
+                if (std::find(images, images + image_count, m) != images + image_count)
+                    continue;
+
+                images[image_count++] = m;
+
+                if (!transforms[g].flip_x && !transforms[g].flip_y)
+                {
+                    graph.store(m, value);
+                    mirrored[worker]++;
+                    continue;
+                }
+
+                const double image_offset_x = offset_x + (m % size) * scale_x_p;
+                const double image_offset_y = offset_y + (m / size) * scale_y_p;
+
+                const unit_class image_c = cull_unit(classify, scale_x_p, scale_y_p, image_offset_x, image_offset_y, ts);
+
+                if (image_c != unit_class::BOUNDARY)
+                {
+                    graph.store(m, image_c == unit_class::INSIDE ? 1.0f : 0.0f);
+                    continue;
+                }
+
+                long long delta = 0;
+
+                if (sampled && lattice_mirror != nullptr && lattice_mirror(samples, (float)scale_x_p, (float)scale_y_p,
+                    (float)offset_x_p, (float)offset_y_p, (float)image_offset_x, (float)image_offset_y, transforms[g], delta))
+                {
+                    // Rounded as the lattice kernel rounds its own count
+                    const long long count = std::llround((double)value * samples2) + delta;
+
+                    graph.store(m, (float)((double)count / samples2));
+                    mirrored[worker]++;
+                    continue;
+                }
+
+                ts.units++;
+                graph.store(m, sample_unit(calc, samples, scale_x_p, scale_y_p, image_offset_x, image_offset_y, ts, ev));
+            }
+        }
+
+        auto chunk_end_time = std::chrono::steady_clock::now();
+        ts.busy_time += std::chrono::duration_cast<std::chrono::nanoseconds>(chunk_end_time - chunk_begin_time).count();
+    };
+
+    // Workers persist across runs, so only scheduling is timed here
+    thread_pool& pool = get_thread_pool();
+    pool.reserve(threads);
+
+    auto begin_time = std::chrono::steady_clock::now();
+
+    // Finding orbits is part of the timed render
+    if (symmetric)
+    {
+        units.reserve(size2);
+
+        for (long long i = 0; i < size2; i++)
+        {
+            if (symmetry_representative(transforms, transform_count, size, (int)(i % size), (int)(i / size)) == i)
+                units.push_back(i);
         }
     }
 
+    pool.run(threads, symmetric ? (long long)units.size() : size2, grain, run_calc);
+
     auto end_time = std::chrono::steady_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - begin_time).count();
 
-    result.sum_single_time = sum_single_time;
-    result.best_single_time = best_single_time;
+    for (const long long m : mirrored)
+        result.mirrored_units += m;
+
+    collect_worker_stats(result, stats, events);
     result.total_time = duration;
 
     return result;
 }
 
-template <vectorization_level vl, graph_shape shape> const multisample_run_result graph_multisample_mt(int size, int samples,
-    float scale_x, float scale_y, float offset_x, float offset_y, int threads, std::vector<float>& graph)
+// Fills graphs[k] with shapes[k] in one pass over the units, scheduled like graph_multisample_mt
+// without culling or mirroring. Each kernel call generates a unit's samples once for every shape.
+inline const multisample_run_result graph_multisample_batch(const calc_batch_func calc, const std::vector<graph_shape>& shapes, int size,
+    int samples, double scale_x, double scale_y, double offset_x, double offset_y, int threads, int grain, std::vector<coverage_buffer>& graphs)
 {
-    const float size2 = size * size;
-    
-    multisample_run_result result;
-    graph = std::vector<float>(size2);
-
-    std::atomic<long long> best_single_time = INT64_MAX;
-    std::atomic<long long> sum_single_time = 0;
+    const int size2 = size * size;
 
-    float scale_x_p = scale_x / size;
-    float scale_y_p = scale_y / size;
+    multisample_run_result result;
 
-    std::vector<std::thread> thread_group(threads);
-    std::atomic<int> n = 0;
+    unsigned set = 0;
+    for (size_t k = 0; k < shapes.size(); k++)
+    {
+        set |= 1u << (int)shapes[k];
+        result.memory.merge(graphs[k].resize(size2, threads));
+    }
 
-    bool ready = false;
+    std::vector<thread_stats> stats(threads);
 
-    std::mutex m;
-    std::condition_variable cv;
+    const double scale_x_p = scale_x / size;
+    const double scale_y_p = scale_y / size;
 
-    static const auto run_calc = [&]
+    const thread_pool::chunk_func run_calc = [&](int worker, long long begin, long long end)
     {
-        std::mutex m_run;
-        std::unique_lock<std::mutex> lk_ready(m_run);
-        cv.wait(lk_ready, [&] { return ready; });
+        thread_stats& ts = stats[worker];
+        float avg[batch_shape_count];
 
-        for (int i = n++; i < size2; i = n++)
-        {
-            int x = i % size;
-            int y = i / size;
-
-            float offset_x_p = offset_x + x * scale_x_p;
-            float offset_y_p = offset_y + y * scale_y_p;
+        auto chunk_begin_time = std::chrono::steady_clock::now();
 
+        for (long long i = begin; i < end; i++)
+        {
+            const double offset_x_p = offset_x + (i % size) * scale_x_p;
+            const double offset_y_p = offset_y + (i / size) * scale_y_p;
 
             auto begin_time = std::chrono::steady_clock::now();
 
-            graph[i] = calc_avg<vl, shape>(samples, scale_x_p, scale_y_p, offset_x_p, offset_y_p);
+            calc(set, samples, (float)scale_x_p, (float)scale_y_p, (float)offset_x_p, (float)offset_y_p, avg);
 
             auto end_time = std::chrono::steady_clock::now();
-            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - begin_time).count();
+            ts.unit_latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - begin_time).count());
+            ts.units++;
 
-            sum_single_time += duration;
-            if (best_single_time > duration)
-                best_single_time = duration;
+            for (size_t k = 0; k < shapes.size(); k++)
+                graphs[k].store(i, avg[(int)shapes[k]]);
         }
 
-        cv.notify_all();
+        auto chunk_end_time = std::chrono::steady_clock::now();
+        ts.busy_time += std::chrono::duration_cast<std::chrono::nanoseconds>(chunk_end_time - chunk_begin_time).count();
     };
 
-    for (int i = 0; i < threads; i++)
+    thread_pool& pool = get_thread_pool();
+    pool.reserve(threads);
+
+    auto begin_time = std::chrono::steady_clock::now();
+
+    pool.run(threads, size2, grain, run_calc);
+
+    auto end_time = std::chrono::steady_clock::now();
+
+    collect_worker_stats(result, stats, {});
+    result.total_time = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - begin_time).count();
+
+    return result;
+}
+
+// One published pass of a progressive render. Sampled units have samples per axis, block is the
+// number of units per axis that show one sampled unit's value (1 once every unit is sampled).
+struct progressive_pass
+{
+    int index;
+    int passes;
+    int samples;
+    int block;
+
+    // Render time since the start, without time spent in callbacks
+    long long time;
+};
+
+typedef std::function<void(const progressive_pass& pass, const coverage_buffer& graph)> progressive_callback;
+
+// Coarsest preview grid has one sampled unit per 2^levels units per axis
+constexpr int progressive_grid_levels = 3;
+
+// Renders the graph in passes that each publish a complete preview. Grid passes sample one unit
+// per block, halving the block each pass, at the odd part of samples per axis. Refinement passes
+// then double the samples per axis of every unit: the samples of m x m lie on the 2m x 2m lattice,
+// so a pass only evaluates the three m x m lattices shifted by half a step and adds their hits.
+// The final pass has sampled the same samples x samples lattice as a direct render, up to the
+// rounding of shifted sample coordinates. Culled units are settled on their first pass. A sampled
+// unit's kernel time over all passes is recorded as one latency once it has all its samples, so
+// unit statistics compare with a direct render. Symmetry is not applied.
+inline const multisample_run_result graph_multisample_progressive(const unit_kernel calc, const classify_func classify, int size, int samples,
+    double scale_x, double scale_y, double offset_x, double offset_y, int threads, int grain, coverage_buffer& graph,
+    const progressive_callback& on_pass = nullptr, bool count_events = false)
+{
+    enum : uint8_t { UNSAMPLED, SAMPLED, SETTLED };
+
+    const long long size2 = (long long)size * size;
+
+    multisample_run_result result;
+    result.memory = graph.resize(size2, threads);
+
+    // Hits and kernel time so far of sampled units, in samples and nanoseconds
+    std::vector<double> hits(size2, 0.0);
+    std::vector<long long> unit_time(size2, 0);
+    std::vector<uint8_t> state(size2, UNSAMPLED);
+
+    std::vector<thread_stats> stats(threads);
+    std::vector<perf_events> events(count_events ? threads : 0);
+
+    const double scale_x_p = scale_x / size;
+    const double scale_y_p = scale_y / size;
+
+    int base = samples;
+    int refinements = 0;
+
+    while (base % 2 == 0)
     {
-        thread_group[i] = std::thread(run_calc);
+        base /= 2;
+        refinements++;
     }
 
-    auto begin_time = std::chrono::steady_clock::now();
+    int grid_levels = 0;
+
+    while (grid_levels < progressive_grid_levels && (2 << grid_levels) <= size)
+        grid_levels++;
+
+    const int passes = grid_levels + 1 + refinements;
 
-    ready = true;
-    cv.notify_all();
+    // State of the current pass: grid passes sample block corners, refinement passes have m samples per axis
+    int block = 1 << grid_levels;
+    int m = base;
+    bool refine = false;
 
+    const thread_pool::chunk_func run_pass = [&](int worker, long long begin, long long end)
     {
-        std::unique_lock<std::mutex> lk(m);
-        cv.wait(lk, [&] { return n >= size2; });
+        thread_stats& ts = stats[worker];
+        perf_events* ev = nullptr;
+
+        if (count_events)
+        {
+            open_worker_events(events, worker);
+            ev = &events[worker];
+        }
+
+        const long long blocks_x = (size + block - 1) / block;
+
+        auto chunk_begin_time = std::chrono::steady_clock::now();
+
+        for (long long u = begin; u < end; u++)
+        {
+            const long long i = refine ? u : (u % blocks_x) * block + (u / blocks_x) * block * size;
+
+            if (state[i] == (refine ? SAMPLED : UNSAMPLED))
+            {
+                const int x = i % size;
+                const int y = i / size;
+
+                const double offset_x_p = offset_x + x * scale_x_p;
+                const double offset_y_p = offset_y + y * scale_y_p;
+
+                ts.units++;
+
+                if (!refine)
+                {
+                    const unit_class c = cull_unit(classify, scale_x_p, scale_y_p, offset_x_p, offset_y_p, ts);
+
+                    if (c == unit_class::BOUNDARY)
+                    {
+                        hits[i] = (double)time_unit(calc, base, scale_x_p, scale_y_p, offset_x_p, offset_y_p, ev, unit_time[i]) * base * base;
+                        state[i] = SAMPLED;
+
+                        if (refinements == 0)
+                            ts.unit_latency.record(unit_time[i]);
+                    }
+                    else
+                    {
+                        hits[i] = c == unit_class::INSIDE ? (double)base * base : 0.0;
+                        state[i] = SETTLED;
+                    }
+
+                    graph.store(i, (float)(hits[i] / ((double)base * base)));
+                }
+                else
+                {
+                    const double half_x = scale_x_p / (2 * m);
+                    const double half_y = scale_y_p / (2 * m);
+
+                    long long durations[3];
+
+                    const double added = (double)time_unit(calc, m, scale_x_p, scale_y_p, offset_x_p + half_x, offset_y_p, ev, durations[0])
+                        + time_unit(calc, m, scale_x_p, scale_y_p, offset_x_p, offset_y_p + half_y, ev, durations[1])
+                        + time_unit(calc, m, scale_x_p, scale_y_p, offset_x_p + half_x, offset_y_p + half_y, ev, durations[2]);
+
+                    hits[i] += added * m * m;
+                    unit_time[i] += durations[0] + durations[1] + durations[2];
+
+                    if (2 * m == samples)
+                        ts.unit_latency.record(unit_time[i]);
+
+                    graph.store(i, (float)(hits[i] / (4.0 * m * m)));
+                }
+            }
+        }
+
+        auto chunk_end_time = std::chrono::steady_clock::now();
+        ts.busy_time += std::chrono::duration_cast<std::chrono::nanoseconds>(chunk_end_time - chunk_begin_time).count();
+    };
+
+    // Units not sampled yet show the value of their block's sampled corner
+    const thread_pool::chunk_func fill_blocks = [&](int, long long begin, long long end)
+    {
+        for (long long i = begin; i < end; i++)
+        {
+            if (state[i] == UNSAMPLED)
+            {
+                const int x = i % size;
+                const int y = i / size;
+
+                graph.copy(i, (x - x % block) + (long long)(y - y % block) * size);
+            }
+        }
+    };
+
+    thread_pool& pool = get_thread_pool();
+    pool.reserve(threads);
+
+    auto begin_time = std::chrono::steady_clock::now();
+    long long callback_time = 0;
+
+    for (int pass = 0; pass < passes; pass++)
+    {
+        refine = pass > grid_levels;
+
+        if (refine)
+        {
+            pool.run(threads, size2, grain, run_pass);
+            m *= 2;
+        }
+        else
+        {
+            block = 1 << (grid_levels - pass);
+
+            const long long blocks_x = (size + block - 1) / block;
+            pool.run(threads, blocks_x * blocks_x, grain, run_pass);
+
+            if (block > 1)
+                pool.run(threads, size2, mirror_grain, fill_blocks);
+        }
+
+        auto pass_end_time = std::chrono::steady_clock::now();
+        const long long time = std::chrono::duration_cast<std::chrono::nanoseconds>(pass_end_time - begin_time).count() - callback_time;
+
+        if (pass == 0)
+            result.first_preview_time = time;
+
+        result.total_time = time;
+
+        if (on_pass)
+        {
+            on_pass({ pass, passes, refine ? m : base, refine ? 1 : block, time }, graph);
+
+            callback_time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - pass_end_time).count();
+        }
     }
 
+    collect_worker_stats(result, stats, events);
+    result.passes = passes;
+
+    return result;
+}
+
+// Renders the graph in tile_size squares, each scheduled index being one tile. Finished tiles go to
+// the writer, so the graph is never held in memory and its mean value is summed per worker instead.
+// Writing overlaps rendering, only the writer's remaining queue is left when this returns.
+inline const multisample_run_result graph_multisample_tiled(const unit_kernel calc, const classify_func classify, int size, int samples,
+    double scale_x, double scale_y, double offset_x, double offset_y, int threads, int tile_size, tiled_image_writer& writer,
+    bool count_events = false)
+{
+    const int tiles_x = (size + tile_size - 1) / tile_size;
+    const long long tile_count = (long long)tiles_x * tiles_x;
+
+    multisample_run_result result;
+
+    std::vector<thread_stats> stats(threads);
+    std::vector<perf_events> events(count_events ? threads : 0);
+
+    const double scale_x_p = scale_x / size;
+    const double scale_y_p = scale_y / size;
+
+    const thread_pool::chunk_func run_tiles = [&](int worker, long long begin, long long end)
+    {
+        thread_stats& ts = stats[worker];
+        perf_events* ev = nullptr;
+
+        if (count_events)
+        {
+            open_worker_events(events, worker);
+            ev = &events[worker];
+        }
+
+        auto chunk_begin_time = std::chrono::steady_clock::now();
+
+        for (long long t = begin; t < end; t++)
+        {
+            tile_rect tile;
+            tile.x = (int)(t % tiles_x) * tile_size;
+            tile.y = (int)(t / tiles_x) * tile_size;
+            tile.width = std::min(tile_size, size - tile.x);
+            tile.height = std::min(tile_size, size - tile.y);
+
+            const tile_buffer buffer = writer.acquire(tile);
+
+            for (int y = 0; y < tile.height; y++)
+            {
+                for (int x = 0; x < tile.width; x++)
+                {
+                    const double offset_x_p = offset_x + (tile.x + x) * scale_x_p;
+                    const double offset_y_p = offset_y + (tile.y + y) * scale_y_p;
+
+                    const float value = run_unit(calc, classify, samples, scale_x_p, scale_y_p, offset_x_p, offset_y_p, ts, ev);
+
+                    buffer.data[x + y * buffer.stride] = value;
+                    ts.value_sum += value;
+                }
+            }
+
+            writer.submit(tile, buffer);
+        }
+
+        auto chunk_end_time = std::chrono::steady_clock::now();
+        ts.busy_time += std::chrono::duration_cast<std::chrono::nanoseconds>(chunk_end_time - chunk_begin_time).count();
+    };
+
+    thread_pool& pool = get_thread_pool();
+    pool.reserve(threads);
+
+    auto begin_time = std::chrono::steady_clock::now();
+
+    pool.run(threads, tile_count, 1, run_tiles);
+
     auto end_time = std::chrono::steady_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - begin_time).count();
 
-    result.sum_single_time = sum_single_time;
-    result.best_single_time = best_single_time;
+    double value_sum = 0.0;
+    for (const thread_stats& ts : stats)
+        value_sum += ts.value_sum;
+
+    collect_worker_stats(result, stats, events);
     result.total_time = duration;
+    result.avg_value = (float)(value_sum / ((double)size * size));
 
-    for (int i = 0; i < threads; i++)
+    return result;
+}
+
+// Unit rectangle of one frame of an animated render
+struct frame_view
+{
+    double scale_x;
+    double scale_y;
+    double offset_x;
+    double offset_y;
+};
+
+// One finished frame of an animated render. Latency runs from the first unit of the frame being
+// handed out to its last unit being stored, including any wait for the frame's buffer.
+struct animation_frame
+{
+    int index;
+    int buffer;
+    long long latency;
+
+    // Time since the start of the render, and time workers waited for the frame's buffer
+    long long time;
+    long long stall_time;
+};
+
+// Called on the worker that stored a frame's last unit, possibly on several workers at once for
+// different frames, so it must not start pool runs. The buffer goes to a later frame once this returns.
+typedef std::function<void(const animation_frame& frame, const coverage_buffer& graph)> animation_callback;
+
+// Renders frame f of views into buffers[f % buffers.size()]. Units of all frames are handed out in
+// frame order from one shared cursor, so workers go on to the next frame while the tail units of
+// the current one finish, with up to buffers.size() frames rendering at once. A worker reaching a
+// frame whose buffer is still in use waits for the frame before it to finish. Buffers are sized
+// once and recycled, no frame allocates. Views move between frames, so units are not mirrored.
+inline const multisample_run_result graph_animation_mt(const unit_kernel calc, const classify_func classify, int size, int samples,
+    const std::vector<frame_view>& views, int threads, int grain, std::vector<coverage_buffer>& buffers,
+    const animation_callback& on_frame, bool count_events = false)
+{
+    const long long size2 = (long long)size * size;
+    const int frames = (int)views.size();
+    const int in_flight = (int)buffers.size();
+
+    multisample_run_result result;
+
+    for (auto& buffer : buffers)
+        result.memory.merge(buffer.resize(size2, threads));
+
+    std::vector<thread_stats> stats(threads);
+    std::vector<perf_events> events(count_events ? threads : 0);
+
+    // Start is -1 until the frame's first unit is handed out, times are ns since the render started
+    struct frame_state
     {
-        thread_group[i].join();
-    }
+        std::atomic<long long> remaining;
+        std::atomic<long long> start_time = -1;
+        std::atomic<long long> stall_time = 0;
+    };
+
+    std::vector<frame_state> states(frames);
+    for (auto& state : states)
+        state.remaining = size2;
+
+    std::mutex m;
+    std::condition_variable cv_retired;
+    std::vector<char> retired(frames);
+
+    std::atomic<long long> cursor = 0;
+    const long long total = size2 * frames;
+
+    auto begin_time = std::chrono::steady_clock::now();
+
+    const auto elapsed = [&]()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin_time).count();
+    };
+
+    // The pool's per-worker ranges would start workers in different frames, so each worker is
+    // scheduled once and takes grain sized chunks from the cursor until every unit is handed out
+    const thread_pool::chunk_func run_frames = [&](int worker, long long, long long)
+    {
+        thread_stats& ts = stats[worker];
+        perf_events* ev = nullptr;
+
+        if (count_events)
+        {
+            open_worker_events(events, worker);
+            ev = &events[worker];
+        }
+
+        // Highest frame whose buffer this worker has seen free, frames only move forward
+        int ready = in_flight - 1;
+
+        auto chunk_begin_time = std::chrono::steady_clock::now();
+
+        for (;;)
+        {
+            const long long begin = cursor.fetch_add(grain);
+
+            if (begin >= total)
+                break;
+
+            const long long end = std::min(begin + grain, total);
+
+            // A chunk may cross into later frames, each frame's part is finished before the next starts
+            for (long long part_begin = begin; part_begin < end;)
+            {
+                const int f = (int)(part_begin / size2);
+                const long long part_end = std::min(end, (f + 1) * size2);
+
+                long long unset = -1;
+                states[f].start_time.compare_exchange_strong(unset, elapsed());
+
+                if (f > ready)
+                {
+                    auto stall_begin_time = std::chrono::steady_clock::now();
+
+                    {
+                        std::unique_lock<std::mutex> lk(m);
+                        cv_retired.wait(lk, [&] { return retired[f - in_flight] != 0; });
+                    }
+
+                    auto stall_end_time = std::chrono::steady_clock::now();
+                    states[f].stall_time += std::chrono::duration_cast<std::chrono::nanoseconds>(stall_end_time - stall_begin_time).count();
+
+                    ready = f;
+                }
+
+                const frame_view& view = views[f];
+                coverage_buffer& graph = buffers[f % in_flight];
+
+                const double scale_x_p = view.scale_x / size;
+                const double scale_y_p = view.scale_y / size;
+
+                for (long long i = part_begin - f * size2; i < part_end - f * size2; i++)
+                {
+                    const double offset_x_p = view.offset_x + (i % size) * scale_x_p;
+                    const double offset_y_p = view.offset_y + (i / size) * scale_y_p;
+
+                    graph.store(i, run_unit(calc, classify, samples, scale_x_p, scale_y_p, offset_x_p, offset_y_p, ts, ev));
+                }
+
+                // The worker storing the frame's last unit hands it on and frees its buffer
+                if (states[f].remaining.fetch_sub(part_end - part_begin) == part_end - part_begin)
+                {
+                    const long long time = elapsed();
+
+                    if (on_frame)
+                        on_frame({ f, f % in_flight, time - states[f].start_time, time, states[f].stall_time }, graph);
+
+                    {
+                        std::lock_guard<std::mutex> lk(m);
+                        retired[f] = 1;
+                    }
+
+                    cv_retired.notify_all();
+                }
+
+                part_begin = part_end;
+            }
+        }
+
+        auto chunk_end_time = std::chrono::steady_clock::now();
+        ts.busy_time += std::chrono::duration_cast<std::chrono::nanoseconds>(chunk_end_time - chunk_begin_time).count();
+    };
+
+    thread_pool& pool = get_thread_pool();
+    pool.reserve(threads);
+
+    pool.run(threads, threads, 1, run_frames);
+
+    auto end_time = std::chrono::steady_clock::now();
+
+    collect_worker_stats(result, stats, events);
+    result.total_time = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - begin_time).count();
 
     return result;
 }
 
-template <vectorization_level vl, graph_shape shape> const auto graph_fixedtime_mt(int size, int samples,
-    float scale_x, float scale_y, float offset_x, float offset_y, int threads, long long time)
+// Completed units of one worker, written only by that worker and read by the sampling thread
+struct alignas(64) unit_counter
+{
+    std::atomic<long long> value = 0;
+};
+
+// Units finishing after the window has closed are not counted. With interval > 0, completed units
+// are sampled every interval ms into the result's timeline. Counted events include the last,
+// uncounted unit of each worker.
+inline const fixedtime_run_result graph_fixedtime_mt(const unit_kernel calc, int size, int samples,
+    double scale_x, double scale_y, double offset_x, double offset_y, int threads, int grain, long long time, long long interval = 0,
+    bool count_events = false)
 {
     const int size2 = size * size;
     
     fixedtime_run_result result;
 
-    std::vector<float> graph(size2);
-
-    float scale_x_p = scale_x / size;
-    float scale_y_p = scale_y / size;
+    coverage_buffer graph;
+    result.memory = graph.resize(size2, threads);
 
-    std::vector<std::thread> thread_group(threads);
-    std::atomic<int> n = 0;
+    const double scale_x_p = scale_x / size;
+    const double scale_y_p = scale_y / size;
 
-    bool ready = false;
+    std::atomic<bool> stop = false;
+    std::vector<unit_counter> completed(threads);
+    std::vector<perf_events> events(count_events ? threads : 0);
 
-    std::mutex m;
-    std::condition_variable cv;
-
-    static const auto run_calc = [&]
+    // Units are handed out from an unbounded range and wrap around the graph
+    const thread_pool::chunk_func run_calc = [&](int worker, long long begin, long long end)
     {
-        std::mutex m_run;
-        std::unique_lock<std::mutex> lk_ready(m_run);
-        cv.wait(lk_ready, [&] { return ready; });
+        std::atomic<long long>& done = completed[worker].value;
+        perf_events* ev = nullptr;
 
-        for (int i = n++; ready; i = n++)
+        if (count_events)
         {
-            int x = i % size;
-            int y = i / size % size2;
+            open_worker_events(events, worker);
+            ev = &events[worker];
+        }
 
-            float offset_x_p = offset_x + x * scale_x_p;
-            float offset_y_p = offset_y + y * scale_y_p;
+        for (long long i = begin; i < end && !stop; i++)
+        {
+            int unit = i % size2;
+            int x = unit % size;
+            int y = unit / size;
 
-            graph[i % size2] = calc_avg<vl, shape>(samples, scale_x_p, scale_y_p, offset_x_p, offset_y_p);
+            const double offset_x_p = offset_x + x * scale_x_p;
+            const double offset_y_p = offset_y + y * scale_y_p;
+
+            if (ev != nullptr)
+                ev->start();
+
+            graph.store(unit, calc(samples, scale_x_p, scale_y_p, offset_x_p, offset_y_p));
+
+            if (ev != nullptr)
+                ev->stop();
+
+            if (stop)
+                break;
+
+            done.store(done.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
         }
     };
 
-    for (int i = 0; i < threads; i++)
+    const auto total_completed = [&]()
     {
-        thread_group[i] = std::thread(run_calc);
-    }
+        long long total = 0;
+        for (const auto& c : completed)
+            total += c.value.load(std::memory_order_relaxed);
+        return total;
+    };
+
+    thread_pool& pool = get_thread_pool();
+    pool.reserve(threads);
 
     auto begin_time = std::chrono::steady_clock::now();
+    const auto stop_time = begin_time + std::chrono::milliseconds(time);
 
-    ready = true;
-    cv.notify_all();
+    pool.start(threads, INT64_MAX, grain, run_calc, &stop);
 
-    std::this_thread::sleep_until(begin_time + std::chrono::milliseconds(time));
-    ready = false;
+    long long sampled = 0;
+    auto sample_time = begin_time;
+
+    if (interval > 0)
+    {
+        for (auto next = begin_time + std::chrono::milliseconds(interval); next < stop_time; next += std::chrono::milliseconds(interval))
+        {
+            std::this_thread::sleep_until(next);
+
+            const auto now = std::chrono::steady_clock::now();
+            const long long total = total_completed();
+
+            result.timeline_units.push_back(total - sampled);
+            result.timeline_time.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - sample_time).count());
+
+            sampled = total;
+            sample_time = now;
+        }
+    }
+
+    std::this_thread::sleep_until(stop_time);
+    stop = true;
 
     auto end_time = std::chrono::steady_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - begin_time).count();
 
-    result.count = n;
+    // Units finished before the stop flag may still be adding to their counters
+    pool.wait();
+
+    result.count = total_completed();
     result.time = duration;
 
-    for (int i = 0; i < threads; i++)
+    collect_worker_events(events, result.counters, result.counter_error);
+
+    if (interval > 0)
     {
-        thread_group[i].join();
+        result.timeline_units.push_back(result.count - sampled);
+        result.timeline_time.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - sample_time).count());
     }
 
     return result;
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <ctime>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <intrin.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <unistd.h>
+#include <sys/utsname.h>
+#include <cpuid.h>
+#endif
+
+#include "drawxy_common.h"
+
+// Description of the machine a benchmark ran on, written with every result record
+struct host_info
+{
+    std::string hostname;
+    std::string cpu_model;
+    std::string os;
+    std::string compiler;
+
+    int logical_cpus;
+    vectorization_level detected_level;
+};
+
+// Processor brand string from CPUID leaves 0x80000002-0x80000004
+inline std::string cpu_brand_string()
+{
+    unsigned int regs[12] = {};
+
+#ifdef _WIN32
+    int info[4];
+    __cpuid(info, 0x80000000);
+
+    if ((unsigned int)info[0] < 0x80000004)
+        return "Unknown";
+
+    for (int i = 0; i < 3; i++)
+    {
+        __cpuid(info, 0x80000002 + i);
+        std::memcpy(&regs[i * 4], info, sizeof(info));
+    }
+#else
+    if (__get_cpuid_max(0x80000000, nullptr) < 0x80000004)
+        return "Unknown";
+
+    for (int i = 0; i < 3; i++)
+    {
+        __get_cpuid(0x80000002 + i, &regs[i * 4], &regs[i * 4 + 1], &regs[i * 4 + 2], &regs[i * 4 + 3]);
+    }
+#endif
+
+    char brand[sizeof(regs) + 1] = {};
+    std::memcpy(brand, regs, sizeof(regs));
+
+    // The brand string is padded with spaces on some processors
+    std::string s(brand);
+    const size_t begin = s.find_first_not_of(' ');
+    const size_t end = s.find_last_not_of(' ');
+
+    return begin == std::string::npos ? "Unknown" : s.substr(begin, end - begin + 1);
+}
+
+inline std::string host_name()
+{
+    char name[256] = {};
+
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+    const int failed = gethostname(name, sizeof(name) - 1);
+    WSACleanup();
+#else
+    const int failed = gethostname(name, sizeof(name) - 1);
+#endif
+
+    return failed != 0 || name[0] == 0 ? "unknown" : name;
+}
+
+inline std::string os_name()
+{
+#ifdef _WIN32
+    return "Windows";
+#else
+    utsname u;
+
+    if (uname(&u) != 0)
+        return "Unknown";
+
+    return std::string(u.sysname) + " " + u.release;
+#endif
+}
+
+inline std::string compiler_name()
+{
+#if defined(__clang__)
+    return std::string("Clang ") + __clang_version__;
+#elif defined(__GNUC__)
+    return std::string("GCC ") + __VERSION__;
+#elif defined(_MSC_VER)
+    return "MSVC " + std::to_string(_MSC_VER);
+#else
+    return "Unknown";
+#endif
+}
+
+inline host_info get_host_info(vectorization_level detected_level)
+{
+    host_info host;
+
+    host.hostname = host_name();
+    host.cpu_model = cpu_brand_string();
+    host.os = os_name();
+    host.compiler = compiler_name();
+    host.logical_cpus = (int)std::thread::hardware_concurrency();
+    host.detected_level = detected_level;
+
+    return host;
+}
+
+// Current UTC time as ISO 8601, e.g. 2024-01-31T12:00:00Z
+inline std::string utc_timestamp()
+{
+    const std::time_t now = std::time(nullptr);
+    std::tm tm;
+
+#ifdef _WIN32
+    gmtime_s(&tm, &now);
+#else
+    gmtime_r(&now, &tm);
+#endif
+
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+    return buffer;
+}
@@ -0,0 +1,2 @@
+// CPU feature detection from the vectorclass library, built without VCL_NAMESPACE
+#include <instrset_detect.cpp>
@@ -0,0 +1,13 @@
+// Kernel build for AVX2 + FMA3, see DrawXY.vcxproj for the target flags
+#define VCL_NAMESPACE drawxy_avx2
+
+#include "drawxy_calc_funcs.h"
+
+namespace drawxy_avx2
+{
+    const kernel_table& get_kernel_table()
+    {
+        static const kernel_table table = make_kernel_table<vectorization_level::AVX2>();
+        return table;
+    }
+}
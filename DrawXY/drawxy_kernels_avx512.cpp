@@ -0,0 +1,13 @@
+// Kernel build for AVX-512 F/VL/BW/DQ, see DrawXY.vcxproj for the target flags
+#define VCL_NAMESPACE drawxy_avx512
+
+#include "drawxy_calc_funcs.h"
+
+namespace drawxy_avx512
+{
+    const kernel_table& get_kernel_table()
+    {
+        static const kernel_table table = make_kernel_table<vectorization_level::AVX512>();
+        return table;
+    }
+}
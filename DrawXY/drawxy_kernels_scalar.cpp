@@ -0,0 +1,13 @@
+// Kernel build for the baseline instruction set, see DrawXY.vcxproj for the target flags
+#define VCL_NAMESPACE drawxy_scalar
+
+#include "drawxy_calc_funcs.h"
+
+namespace drawxy_scalar
+{
+    const kernel_table& get_kernel_table()
+    {
+        static const kernel_table table = make_kernel_table<vectorization_level::NONE>();
+        return table;
+    }
+}
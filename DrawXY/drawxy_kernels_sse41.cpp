@@ -0,0 +1,13 @@
+// Kernel build for SSE4.1, see DrawXY.vcxproj for the target flags
+#define VCL_NAMESPACE drawxy_sse41
+
+#include "drawxy_calc_funcs.h"
+
+namespace drawxy_sse41
+{
+    const kernel_table& get_kernel_table()
+    {
+        static const kernel_table table = make_kernel_table<vectorization_level::SSE4>();
+        return table;
+    }
+}
@@ -0,0 +1,412 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <new>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+#include "drawxy_thread_pool.h"
+
+// Pages backing in-memory graphs
+enum class huge_page_mode
+{
+    NONE,
+    TRANSPARENT,
+    EXPLICIT
+};
+
+constexpr int huge_page_mode_count = 3;
+
+inline std::string huge_page_mode_to_string(huge_page_mode obj)
+{
+    switch (obj)
+    {
+    case huge_page_mode::NONE:
+        return "None [base pages]";
+    case huge_page_mode::TRANSPARENT:
+        return "Transparent [THP hint, 2 MB aligned]";
+    case huge_page_mode::EXPLICIT:
+        return "Explicit [reserved huge pages]";
+    }
+}
+
+// Huge page size of x86-64, graphs in a huge page mode are mapped in multiples of it
+constexpr size_t huge_page_bytes = (size_t)2 << 20;
+
+// Graph blocks kept for reuse, the oldest are unmapped beyond this
+constexpr int max_cached_graph_blocks = 16;
+
+inline size_t base_page_bytes()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// Page faults of the process so far, -1 where the OS does not report them
+inline long long process_page_faults()
+{
+#ifdef _WIN32
+    return -1;
+#else
+    rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+
+    return usage.ru_minflt + usage.ru_majflt;
+#endif
+}
+
+// Memory mapped from the OS for one graph. Base and transparent huge pages are only backed when
+// first written, so the thread writing a page first decides its NUMA node.
+struct graph_block
+{
+    void* data = nullptr;
+    size_t bytes = 0;
+
+    // Bytes asked for, blocks are reused for requests of the same size
+    size_t requested = 0;
+
+    huge_page_mode mode = huge_page_mode::NONE;
+
+    // Huge pages are in effect: explicit pages were mapped or the transparent hint was accepted
+    bool huge = false;
+
+    // Workers that first touched the pages, 0 before the first touch
+    int touch_threads = 0;
+
+    // Why the requested huge pages are not in effect
+    std::string error;
+};
+
+// Maps at least bytes, rounded up to whole pages of the mode. Explicit huge pages fall back to base
+// pages with error set when none can be mapped, data is null when no memory could be mapped at all.
+inline graph_block map_graph_block(const size_t bytes, const huge_page_mode mode)
+{
+    graph_block block;
+    block.mode = mode;
+    block.requested = bytes;
+
+    const size_t page = mode == huge_page_mode::NONE ? base_page_bytes() : huge_page_bytes;
+    block.bytes = (bytes > 0 ? bytes + page - 1 : page) / page * page;
+
+#ifdef _WIN32
+    if (mode == huge_page_mode::EXPLICIT)
+    {
+        // Large pages are committed and locked when mapped, they need the lock pages privilege
+        const size_t large = GetLargePageMinimum();
+        const size_t large_bytes = large > 0 ? (block.bytes + large - 1) / large * large : 0;
+
+        if (large > 0)
+            block.data = VirtualAlloc(nullptr, large_bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+        if (block.data != nullptr)
+        {
+            block.bytes = large_bytes;
+            block.huge = true;
+            return block;
+        }
+
+        block.error = "Large pages unavailable (error " + std::to_string(GetLastError()) + "), using base pages";
+    }
+    else if (mode == huge_page_mode::TRANSPARENT)
+    {
+        block.error = "No transparent huge pages on Windows, using base pages";
+    }
+
+    block.data = VirtualAlloc(nullptr, block.bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    const int prot = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    if (mode == huge_page_mode::EXPLICIT)
+    {
+#ifdef MAP_HUGETLB
+        void* p = mmap(nullptr, block.bytes, prot, flags | MAP_HUGETLB, -1, 0);
+
+        if (p != MAP_FAILED)
+        {
+            block.data = p;
+            block.huge = true;
+            return block;
+        }
+
+        block.error = "Explicit huge pages unavailable (" + std::string(std::strerror(errno)) + "), using base pages";
+#else
+        block.error = "No explicit huge pages on this OS, using base pages";
+#endif
+    }
+
+    if (mode == huge_page_mode::TRANSPARENT)
+    {
+        // Mapped one huge page longer and trimmed, so the block starts on a huge page boundary
+        const size_t mapped = block.bytes + huge_page_bytes;
+        char* p = (char*)mmap(nullptr, mapped, prot, flags, -1, 0);
+
+        if (p == MAP_FAILED)
+            return block;
+
+        char* aligned = (char*)(((uintptr_t)p + huge_page_bytes - 1) & ~(uintptr_t)(huge_page_bytes - 1));
+
+        if (aligned > p)
+            munmap(p, aligned - p);
+        if (p + mapped > aligned + block.bytes)
+            munmap(aligned + block.bytes, p + mapped - (aligned + block.bytes));
+
+        block.data = aligned;
+
+#ifdef MADV_HUGEPAGE
+        block.huge = madvise(aligned, block.bytes, MADV_HUGEPAGE) == 0;
+
+        if (!block.huge)
+            block.error = "Transparent huge page hint rejected (" + std::string(std::strerror(errno)) + ")";
+#else
+        block.error = "No transparent huge pages on this OS, using base pages";
+#endif
+
+        return block;
+    }
+
+    void* p = mmap(nullptr, block.bytes, prot, flags, -1, 0);
+    block.data = p != MAP_FAILED ? p : nullptr;
+#endif
+
+    return block;
+}
+
+inline void unmap_graph_block(graph_block& block)
+{
+    if (block.data == nullptr)
+        return;
+
+#ifdef _WIN32
+    VirtualFree(block.data, 0, MEM_RELEASE);
+#else
+    munmap(block.data, block.bytes);
+#endif
+
+    block.data = nullptr;
+}
+
+// Writes one byte of every page on the first threads pool workers, so the render itself takes no
+// page faults. Pages are split into equal ranges like the starting ranges of a render's units. With
+// pinned workers, a plain render whose ranges are not stolen finds its units' pages on its own
+// node; mirrored, progressive and animation renders schedule units differently, unpinned workers
+// can move, and then pages are only spread over the nodes. Fresh pages read as zero, the written
+// zeros change nothing.
+inline void first_touch(graph_block& block, const int threads)
+{
+    const size_t page = block.huge ? huge_page_bytes : base_page_bytes();
+    const long long pages = (long long)(block.bytes / page);
+
+    volatile char* data = (volatile char*)block.data;
+
+    const thread_pool::chunk_func touch = [&](int, long long begin, long long end)
+    {
+        for (long long p = begin; p < end; p++)
+            data[p * page] = 0;
+    };
+
+    thread_pool& pool = get_thread_pool();
+    pool.run(threads, pages, (pages + threads - 1) / threads, touch);
+
+    block.touch_threads = threads;
+}
+
+// Cost of making a run's graphs ready, measured apart from the render
+struct graph_memory_stats
+{
+    // Mapping blocks or taking them from the pool, and the first touch that faults pages in
+    long long alloc_time = 0;
+    long long touch_time = 0;
+
+    // Faults during first touch, -1 where the OS does not report them
+    long long page_faults = 0;
+
+    int blocks = 0;
+    int reused_blocks = 0;
+    long long bytes = 0;
+
+    huge_page_mode mode = huge_page_mode::NONE;
+
+    // Huge pages are in effect for every block
+    bool huge = false;
+    std::string error;
+
+    void merge(const graph_memory_stats& other)
+    {
+        alloc_time += other.alloc_time;
+        touch_time += other.touch_time;
+        page_faults = page_faults < 0 || other.page_faults < 0 ? -1 : page_faults + other.page_faults;
+        huge = blocks > 0 ? huge && other.huge : other.huge;
+        blocks += other.blocks;
+        reused_blocks += other.reused_blocks;
+        bytes += other.bytes;
+        mode = other.mode;
+
+        if (error.empty())
+            error = other.error;
+    }
+};
+
+// Graph blocks kept between runs, so repeated runs neither map nor fault their graphs again. A
+// block is only reused for the same size and number of touching workers, so it keeps the page
+// layout first_touch gave it. Changing the huge page mode or the thread placement unmaps the
+// cached blocks.
+class graph_pool
+{
+public:
+    ~graph_pool()
+    {
+        trim();
+    }
+
+    // Settings of the following acquires, layout identifies the workers' placement
+    void configure(const huge_page_mode mode, const bool pooled, const int layout)
+    {
+        if (mode != current_mode || pooled != current_pooled || layout != current_layout)
+            trim();
+
+        std::lock_guard<std::mutex> lk(m);
+        current_mode = mode;
+        current_pooled = pooled;
+        current_layout = layout;
+    }
+
+    // A cached block of bytes touched by touch_threads workers, or a fresh untouched mapping.
+    // Throws std::bad_alloc when nothing can be mapped.
+    graph_block acquire(const size_t bytes, const int touch_threads, bool& reused)
+    {
+        huge_page_mode mode;
+
+        {
+            std::lock_guard<std::mutex> lk(m);
+
+            for (size_t i = 0; i < cached.size(); i++)
+            {
+                if (cached[i].requested == bytes && cached[i].touch_threads == touch_threads)
+                {
+                    graph_block block = std::move(cached[i]);
+                    cached.erase(cached.begin() + i);
+
+                    reused = true;
+                    return block;
+                }
+            }
+
+            mode = current_mode;
+        }
+
+        graph_block block = map_graph_block(bytes, mode);
+
+        if (block.data == nullptr)
+            throw std::bad_alloc();
+
+        reused = false;
+        return block;
+    }
+
+    // Keeps the block for reuse, or unmaps it when pooling is off
+    void release(graph_block block)
+    {
+        std::lock_guard<std::mutex> lk(m);
+
+        if (!current_pooled || block.mode != current_mode)
+        {
+            unmap_graph_block(block);
+            return;
+        }
+
+        cached.push_back(std::move(block));
+
+        if ((int)cached.size() > max_cached_graph_blocks)
+        {
+            unmap_graph_block(cached.front());
+            cached.erase(cached.begin());
+        }
+    }
+
+    void trim()
+    {
+        std::lock_guard<std::mutex> lk(m);
+
+        for (auto& block : cached)
+            unmap_graph_block(block);
+
+        cached.clear();
+    }
+
+private:
+    std::mutex m;
+    std::vector<graph_block> cached;
+
+    huge_page_mode current_mode = huge_page_mode::NONE;
+    bool current_pooled = true;
+    int current_layout = 0;
+};
+
+// Pool shared by all graphs of all runs
+inline graph_pool& get_graph_pool()
+{
+    static graph_pool pool;
+    return pool;
+}
+
+// Takes a block of bytes from the pool and first touches fresh blocks on threads workers
+inline graph_block acquire_graph_block(const size_t bytes, const int threads, graph_memory_stats& stats)
+{
+    const auto alloc_begin_time = std::chrono::steady_clock::now();
+
+    bool reused = false;
+    graph_block block = get_graph_pool().acquire(bytes, threads, reused);
+
+    const auto alloc_end_time = std::chrono::steady_clock::now();
+
+    stats.alloc_time += std::chrono::duration_cast<std::chrono::nanoseconds>(alloc_end_time - alloc_begin_time).count();
+
+    if (block.touch_threads == 0)
+    {
+        const long long faults_before = process_page_faults();
+
+        first_touch(block, threads);
+
+        const long long faults_after = process_page_faults();
+
+        stats.touch_time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - alloc_end_time).count();
+        stats.page_faults = stats.page_faults < 0 || faults_before < 0 ? -1 : stats.page_faults + faults_after - faults_before;
+    }
+
+    stats.huge = stats.blocks > 0 ? stats.huge && block.huge : block.huge;
+    stats.blocks++;
+    stats.reused_blocks += reused;
+    stats.bytes += block.bytes;
+    stats.mode = block.mode;
+
+    if (stats.error.empty())
+        stats.error = block.error;
+
+    return block;
+}
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+#ifdef __linux__
+#include <cerrno>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <cpuid.h>
+#endif
+
+// Hardware event counts of the kernel calls made by one or more threads. FP counts follow Intel's
+// FP_ARITH_INST_RETIRED split by width: scalar, 128, 256 and 512 bit. FMA instructions count twice.
+struct perf_counts
+{
+    bool valid = false;
+    bool fp_valid = false;
+
+    long long cycles = 0;
+    long long instructions = 0;
+    long long cache_misses = 0;
+    long long branch_misses = 0;
+
+    long long fp_single[4] = {};
+    long long fp_double[4] = {};
+
+    void merge(const perf_counts& other)
+    {
+        if (!other.valid)
+            return;
+
+        fp_valid = valid ? fp_valid && other.fp_valid : other.fp_valid;
+        valid = true;
+
+        cycles += other.cycles;
+        instructions += other.instructions;
+        cache_misses += other.cache_misses;
+        branch_misses += other.branch_misses;
+
+        for (int i = 0; i < 4; i++)
+        {
+            fp_single[i] += other.fp_single[i];
+            fp_double[i] += other.fp_double[i];
+        }
+    }
+
+    double ipc() const
+    {
+        return cycles > 0 ? (double)instructions / cycles : 0.0;
+    }
+
+    long long fp_instructions() const
+    {
+        long long sum = 0;
+        for (int i = 0; i < 4; i++)
+            sum += fp_single[i] + fp_double[i];
+        return sum;
+    }
+
+    // Lanes per instruction: 1 scalar, then 4/8/16 single or 2/4/8 double
+    double flops() const
+    {
+        return (double)fp_single[0] + 4.0 * fp_single[1] + 8.0 * fp_single[2] + 16.0 * fp_single[3]
+            + (double)fp_double[0] + 2.0 * fp_double[1] + 4.0 * fp_double[2] + 8.0 * fp_double[3];
+    }
+};
+
+// Counters of the calling thread through perf_event_open, opened disabled and only counting
+// between start() and stop(). Three groups are used: cycles, instructions, cache and branch misses,
+// and on Intel the single and double precision FP_ARITH events. The kernel multiplexes the groups
+// when there are not enough counters, counts are scaled by the time each group was scheduled.
+// Without perf support (other systems, containers, perf_event_paranoid) open() fails and error
+// says why, FP counts alone may be missing on non-Intel CPUs or VMs without a virtual PMU.
+class perf_events
+{
+public:
+    perf_events() = default;
+    perf_events(const perf_events&) = delete;
+    perf_events& operator=(const perf_events&) = delete;
+
+    ~perf_events()
+    {
+        close_all();
+    }
+
+    bool is_open() const
+    {
+        return groups[0].leader >= 0;
+    }
+
+    bool open()
+    {
+#ifdef __linux__
+        if (is_open())
+            return true;
+
+        const uint64_t base_events[4][2] = {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES } };
+
+        if (!open_group(groups[0], base_events))
+        {
+            error = std::string("perf_event_open failed: ") + std::strerror(errno);
+            close_all();
+            return false;
+        }
+
+        // FP_ARITH_INST_RETIRED (event 0xC7), umask per width and precision
+        if (is_intel())
+        {
+            const uint64_t single_events[4][2] = {
+                { PERF_TYPE_RAW, 0x02c7 }, { PERF_TYPE_RAW, 0x08c7 }, { PERF_TYPE_RAW, 0x20c7 }, { PERF_TYPE_RAW, 0x80c7 } };
+            const uint64_t double_events[4][2] = {
+                { PERF_TYPE_RAW, 0x01c7 }, { PERF_TYPE_RAW, 0x04c7 }, { PERF_TYPE_RAW, 0x10c7 }, { PERF_TYPE_RAW, 0x40c7 } };
+
+            if (!open_group(groups[1], single_events) || !open_group(groups[2], double_events))
+            {
+                close_group(groups[1]);
+                close_group(groups[2]);
+            }
+        }
+
+        return true;
+#else
+        error = "performance counters need Linux perf_event_open";
+        return false;
+#endif
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        for (const auto& g : groups)
+        {
+            if (g.leader >= 0)
+                ioctl(g.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    void stop()
+    {
+#ifdef __linux__
+        for (const auto& g : groups)
+        {
+            if (g.leader >= 0)
+                ioctl(g.leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    // Counts so far, only consistent while stopped
+    perf_counts read() const
+    {
+        perf_counts counts;
+
+        long long base[4];
+        if (!read_group(groups[0], base))
+            return counts;
+
+        counts.valid = true;
+        counts.cycles = base[0];
+        counts.instructions = base[1];
+        counts.cache_misses = base[2];
+        counts.branch_misses = base[3];
+
+        counts.fp_valid = read_group(groups[1], counts.fp_single) && read_group(groups[2], counts.fp_double);
+
+        return counts;
+    }
+
+    std::string error;
+
+private:
+    struct event_group
+    {
+        int leader = -1;
+        int fds[4] = { -1, -1, -1, -1 };
+    };
+
+#ifdef __linux__
+    static bool is_intel()
+    {
+        unsigned int eax, ebx, ecx, edx;
+
+        if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx))
+            return false;
+
+        char vendor[13] = {};
+        std::memcpy(vendor, &ebx, 4);
+        std::memcpy(vendor + 4, &edx, 4);
+        std::memcpy(vendor + 8, &ecx, 4);
+
+        return std::strcmp(vendor, "GenuineIntel") == 0;
+    }
+
+    static bool open_group(event_group& g, const uint64_t (&events)[4][2])
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+
+            attr.size = sizeof(attr);
+            attr.type = (uint32_t)events[i][0];
+            attr.config = events[i][1];
+            attr.disabled = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            const int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : g.leader, 0);
+
+            if (fd < 0)
+            {
+                close_group(g);
+                return false;
+            }
+
+            g.fds[i] = fd;
+            if (i == 0)
+                g.leader = fd;
+        }
+
+        return true;
+    }
+#endif
+
+    static void close_group(event_group& g)
+    {
+#ifdef __linux__
+        for (int& fd : g.fds)
+        {
+            if (fd >= 0)
+                close(fd);
+            fd = -1;
+        }
+#endif
+        g.leader = -1;
+    }
+
+    void close_all()
+    {
+        for (auto& g : groups)
+            close_group(g);
+    }
+
+    static bool read_group(const event_group& g, long long (&values)[4])
+    {
+#ifdef __linux__
+        if (g.leader < 0)
+            return false;
+
+        // nr, time enabled, time running, then one value per event
+        uint64_t data[3 + 4];
+
+        if (::read(g.leader, data, sizeof(data)) != (ssize_t)sizeof(data) || data[0] != 4)
+            return false;
+
+        const double scale = data[2] > 0 ? (double)data[1] / data[2] : 0.0;
+
+        for (int i = 0; i < 4; i++)
+            values[i] = (long long)(data[3 + i] * scale + 0.5);
+
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    event_group groups[3];
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+#include "drawxy_common.h"
+#include "drawxy_structs.h"
+#include "drawxy_graph_funcs.h"
+#include "drawxy_run.h"
+
+struct precision_point
+{
+    precision_mode precision;
+    int runs;
+    long long score;
+
+    // Half width of the score's 95% confidence interval relative to its mean
+    double relative_ci;
+
+    // Score relative to single precision
+    double relative_throughput;
+
+    // Largest coverage difference of a unit from the double precision graph, and units that differ
+    double max_unit_error;
+    long long mismatched_units;
+
+    bool correct;
+};
+
+// Largest per unit coverage error still counted as correct
+constexpr double precision_tolerance = 1e-3;
+
+// Runs the benchmark loop once per precision mode at the params' view and compares each mode's
+// graph with the double precision graph, so the cheapest mode that is still correct at this zoom
+// can be picked. Graphs come from one extra multisample run per mode.
+inline std::vector<precision_point> run_precision_sweep(const run_params params, const bench_type bench, const long long time, const int loops,
+    const double tolerance = precision_tolerance)
+{
+    std::ostream& out = report_stream(params);
+
+    run_params quiet = params;
+    quiet.verbose = false;
+    quiet.precision = precision_mode::DOUBLE;
+
+    // Quantized graphs would count their rounding as precision error
+    quiet.coverage = coverage_format::FLOAT32;
+
+    std::vector<float> reference;
+    run_multisample_single(quiet, &reference);
+
+    std::vector<precision_point> points;
+
+    for (int m = 0; m < precision_mode_count; m++)
+    {
+        run_params p = params;
+        p.precision = (precision_mode)m;
+
+        const score_summary summary = bench == bench_type::MULTISAMPLE ? run_multisample_loop(p, loops) : run_fixedtime_loop(p, time, loops);
+
+        std::vector<float> graph;
+
+        if (p.precision == precision_mode::DOUBLE)
+        {
+            graph = reference;
+        }
+        else
+        {
+            quiet.precision = p.precision;
+            run_multisample_single(quiet, &graph);
+        }
+
+        precision_point point;
+        point.precision = p.precision;
+        point.runs = summary.runs();
+        point.score = summary.score;
+        point.relative_ci = summary.relative_ci();
+        point.max_unit_error = 0.0;
+        point.mismatched_units = 0;
+
+        for (size_t i = 0; i < graph.size(); i++)
+        {
+            const double error = std::abs((double)graph[i] - reference[i]);
+
+            point.max_unit_error = error > point.max_unit_error ? error : point.max_unit_error;
+            point.mismatched_units += error > 0.0;
+        }
+
+        point.correct = point.max_unit_error <= tolerance;
+
+        points.push_back(point);
+    }
+
+    const double single_score = (double)points[(int)precision_mode::SINGLE].score;
+
+    for (auto& point : points)
+        point.relative_throughput = single_score > 0.0 ? point.score / single_score : 0.0;
+
+    out << "Precision Comparison" << std::endl;
+    out << "View:                 zoom " << params.zoom << " at (" << params.center_x << ", " << params.center_y << ")" << std::endl;
+    out << "Sample spacing:       " << params.view_scale() / ((double)params.size * params.samples) << std::endl;
+    out << "Error tolerance:      " << tolerance << " of a unit" << std::endl;
+
+    const precision_point* cheapest = nullptr;
+
+    for (const auto& point : points)
+    {
+        out << "  " << precision_mode_to_string(point.precision) << ": score " << point.score << " (+-" << point.relative_ci * 100
+            << "%), " << point.relative_throughput << "x single, max unit error " << point.max_unit_error << ", "
+            << point.mismatched_units << " units differ" << (point.correct ? "" : " [INCORRECT]") << std::endl;
+
+        if (point.correct && (cheapest == nullptr || point.score > cheapest->score))
+            cheapest = &point;
+    }
+
+    out << "Cheapest correct:     " << (cheapest != nullptr ? precision_mode_to_string(cheapest->precision) : "none") << std::endl;
+    out << std::endl;
+
+    return points;
+}
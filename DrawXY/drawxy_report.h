@@ -0,0 +1,560 @@
+#pragma once
+
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+#include "drawxy_common.h"
+#include "drawxy_structs.h"
+#include "drawxy_host.h"
+#include "drawxy_scaling.h"
+#include "drawxy_precision.h"
+#include "drawxy_batch.h"
+#include "drawxy_animation.h"
+
+enum class record_format
+{
+    JSON,
+    CSV
+};
+
+inline std::string record_format_to_string(record_format obj)
+{
+    switch (obj)
+    {
+    case record_format::JSON:
+        return "JSON lines";
+    case record_format::CSV:
+        return "CSV";
+    }
+}
+
+// One flat result record. Every record has the same fields in the same order, fields that do not
+// apply to a benchmark type are left empty (null in JSON) so CSV rows line up under one header.
+class result_record
+{
+public:
+    void add(const std::string& key, const std::string& value)
+    {
+        fields.push_back({ key, { value, true } });
+    }
+
+    void add(const std::string& key, const char* value)
+    {
+        add(key, std::string(value));
+    }
+
+    void add(const std::string& key, const bool value)
+    {
+        fields.push_back({ key, { value ? "true" : "false", false } });
+    }
+
+    template <typename T> void add(const std::string& key, const T value, const int precision = 10)
+    {
+        std::ostringstream s;
+        s.precision(precision);
+        s << value;
+
+        fields.push_back({ key, { s.str(), false } });
+    }
+
+    void add_empty(const std::string& key)
+    {
+        fields.push_back({ key, { "", false } });
+    }
+
+    std::string to_json() const
+    {
+        std::string s = "{";
+
+        for (size_t i = 0; i < fields.size(); i++)
+        {
+            const auto& [key, field] = fields[i];
+
+            s += (i > 0 ? ",\"" : "\"") + key + "\":";
+
+            if (field.second)
+                s += json_quote(field.first);
+            else
+                s += field.first.empty() ? "null" : field.first;
+        }
+
+        return s + "}";
+    }
+
+    std::string csv_header() const
+    {
+        std::string s;
+
+        for (size_t i = 0; i < fields.size(); i++)
+        {
+            s += (i > 0 ? "," : "") + fields[i].first;
+        }
+
+        return s;
+    }
+
+    std::string to_csv() const
+    {
+        std::string s;
+
+        for (size_t i = 0; i < fields.size(); i++)
+        {
+            s += (i > 0 ? "," : "") + csv_quote(fields[i].second.first);
+        }
+
+        return s;
+    }
+
+private:
+    static std::string json_quote(const std::string& value)
+    {
+        std::string s = "\"";
+
+        for (const char c : value)
+        {
+            if (c == '"' || c == '\\')
+                s += '\\';
+
+            if ((unsigned char)c < 0x20)
+                s += ' ';
+            else
+                s += c;
+        }
+
+        return s + "\"";
+    }
+
+    static std::string csv_quote(const std::string& value)
+    {
+        if (value.find_first_of(",\"\n") == std::string::npos)
+            return value;
+
+        std::string s = "\"";
+
+        for (const char c : value)
+        {
+            if (c == '"')
+                s += '"';
+            s += c;
+        }
+
+        return s + "\"";
+    }
+
+    // Key, value and whether the value is a string
+    std::vector<std::pair<std::string, std::pair<std::string, bool>>> fields;
+};
+
+// Writes records to a stream. existing is the first line already in the stream: CSV records get a
+// header line when there is none and are only appended below a header of the same columns, JSON
+// lines only to JSON lines.
+class result_writer
+{
+public:
+    result_writer(std::ostream& out, record_format format, const std::string& existing = std::string())
+        : out(out), format(format), header(existing) {}
+
+    // Throws std::runtime_error when the record does not fit the records already written
+    void write(const result_record& record)
+    {
+        if (format == record_format::CSV)
+        {
+            const std::string columns = record.csv_header();
+
+            if (header.empty())
+            {
+                out << columns << '\n';
+                header = columns;
+            }
+            else if (columns != header)
+            {
+                throw std::runtime_error("Output already holds records with other columns, write these to a new file");
+            }
+
+            out << record.to_csv() << '\n';
+        }
+        else
+        {
+            if (!header.empty() && header[0] != '{')
+                throw std::runtime_error("Output already holds records that are not JSON lines, write these to a new file");
+
+            out << record.to_json() << '\n';
+        }
+
+        // Records are flushed one by one so a killed run keeps everything finished so far
+        out.flush();
+    }
+
+private:
+    std::ostream& out;
+    record_format format;
+    std::string header;
+};
+
+inline void add_host_fields(result_record& record, const host_info& host)
+{
+    record.add("timestamp", utc_timestamp());
+    record.add("host", host.hostname);
+    record.add("cpu", host.cpu_model);
+    record.add("logical_cpus", host.logical_cpus);
+    record.add("os", host.os);
+    record.add("compiler", host.compiler);
+    record.add("detected_vec_level", vec_level_to_string(host.detected_level));
+}
+
+inline void add_param_fields(result_record& record, const run_params& params, const std::string& bench, const std::string& shape,
+    const long long time, const int run, const int runs)
+{
+    record.add("bench", bench);
+    record.add("shape", shape);
+    record.add("vec_level", vec_level_to_string(params.vec_level));
+    record.add("kernel", params.program != nullptr ? std::string("Program interpreter") : sampling_kernel_to_string(params.kernel));
+
+    if (params.program == nullptr && params.kernel == sampling_kernel::ROW_SWEEP && params.accumulators > 0)
+        record.add("accumulators", params.accumulators);
+    else
+        record.add_empty("accumulators");
+
+    record.add("cull", cull_mode_to_string(params.program != nullptr ? cull_mode::NONE : params.cull));
+    record.add("samples", params.samples);
+    record.add("size", params.size);
+    record.add("threads", params.threads);
+    record.add("grain", params.grain);
+    record.add("placement", thread_placement_to_string(params.placement));
+    record.add("precision", precision_mode_to_string(effective_precision(params)));
+    record.add("coverage_format", coverage_format_to_string(params.coverage));
+    record.add("huge_pages", huge_page_mode_to_string(params.huge_pages));
+    record.add("graph_pool", params.graph_pool);
+    record.add("symmetry", params.symmetry);
+    record.add("progressive", params.progressive);
+
+    if (params.program == nullptr && is_escape_shape(params.shape))
+        record.add("max_iterations", params.max_iterations);
+    else
+        record.add_empty("max_iterations");
+
+    // Deep zoom centers need every digit of a double
+    record.add("zoom", params.zoom);
+    record.add("center_x", params.center_x, 17);
+    record.add("center_y", params.center_y, 17);
+
+    if (time > 0)
+        record.add("time_ms", time);
+    else
+        record.add_empty("time_ms");
+
+    if (run >= 0)
+        record.add("run", run + 1);
+    else
+        record.add_empty("run");
+
+    record.add("runs", runs);
+}
+
+// Graph memory fields of a run, empty when the run held no graph in memory
+inline void add_graph_memory_fields(result_record& record, const graph_memory_stats& memory)
+{
+    if (memory.blocks == 0)
+    {
+        record.add_empty("graph_alloc_ns");
+        record.add_empty("graph_touch_ns");
+        record.add_empty("graph_page_faults");
+        record.add_empty("graph_blocks_reused");
+        record.add_empty("huge_pages_in_effect");
+        return;
+    }
+
+    record.add("graph_alloc_ns", memory.alloc_time);
+    record.add("graph_touch_ns", memory.touch_time);
+
+    if (memory.page_faults >= 0)
+        record.add("graph_page_faults", memory.page_faults);
+    else
+        record.add_empty("graph_page_faults");
+
+    record.add("graph_blocks_reused", memory.reused_blocks);
+    record.add("huge_pages_in_effect", memory.huge);
+}
+
+// Counter fields of a run, empty when counters were off or unavailable. samples is the number of
+// samples the counted kernel calls evaluated.
+inline void add_counter_fields(result_record& record, const perf_counts& counters, const double samples)
+{
+    if (!counters.valid)
+    {
+        for (const char* key : { "cycles", "instructions", "ipc", "samples_per_cycle", "fp_instructions", "flops_per_cycle", "cache_misses", "branch_misses" })
+            record.add_empty(key);
+        return;
+    }
+
+    record.add("cycles", counters.cycles);
+    record.add("instructions", counters.instructions);
+    record.add("ipc", counters.ipc());
+    record.add("samples_per_cycle", counters.cycles > 0 ? samples / counters.cycles : 0.0);
+
+    if (counters.fp_valid)
+    {
+        record.add("fp_instructions", counters.fp_instructions());
+        record.add("flops_per_cycle", counters.cycles > 0 ? counters.flops() / counters.cycles : 0.0);
+    }
+    else
+    {
+        record.add_empty("fp_instructions");
+        record.add_empty("flops_per_cycle");
+    }
+
+    record.add("cache_misses", counters.cache_misses);
+    record.add("branch_misses", counters.branch_misses);
+}
+
+inline result_record make_multisample_record(const host_info& host, const run_params& params, const std::string& shape,
+    const int run, const int runs, const multisample_run_result& result)
+{
+    result_record record;
+
+    add_host_fields(record, host);
+    add_param_fields(record, params, "multisample", shape, 0, run, runs);
+
+    record.add("score", result.score());
+    record.add("total_time_ns", result.total_time);
+    record.add("sum_unit_time_ns", result.sum_single_time);
+    record.add("best_unit_time_ns", result.best_single_time);
+    record.add("unit_p50_ns", result.unit_latency.percentile(50));
+    record.add("unit_p90_ns", result.unit_latency.percentile(90));
+    record.add("unit_p99_ns", result.unit_latency.percentile(99));
+    record.add("unit_max_ns", result.unit_latency.max);
+    record.add("inside_units", result.inside_units);
+    record.add("outside_units", result.outside_units);
+    record.add("mirrored_units", result.mirrored_units);
+    record.add("avg_value", result.avg_value);
+    record.add_empty("units_processed");
+    record.add_empty("early_units_per_s");
+    record.add_empty("late_units_per_s");
+    record.add_empty("throttled");
+    record.add_empty("timeline_units");
+
+    if (result.first_preview_time >= 0)
+    {
+        record.add("passes", result.passes);
+        record.add("first_preview_ns", result.first_preview_time);
+        record.add("final_ns", result.total_time);
+    }
+    else
+    {
+        record.add_empty("passes");
+        record.add_empty("first_preview_ns");
+        record.add_empty("final_ns");
+    }
+
+    if (result.reduce_time >= 0)
+    {
+        record.add("graph_bytes", result.graph_bytes);
+        record.add("reduce_ns", result.reduce_time);
+    }
+    else
+    {
+        record.add_empty("graph_bytes");
+        record.add_empty("reduce_ns");
+    }
+
+    // Image output of tiled renders
+    if (result.io_write_time >= 0)
+    {
+        record.add("image_write_ns", result.io_write_time);
+        record.add("image_stall_ns", result.io_stall_time);
+        record.add("image_flush_ns", result.io_flush_time);
+    }
+    else
+    {
+        record.add_empty("image_write_ns");
+        record.add_empty("image_stall_ns");
+        record.add_empty("image_flush_ns");
+    }
+
+    add_graph_memory_fields(record, result.memory);
+
+    const double size2 = (double)params.size * params.size;
+    add_counter_fields(record, result.counters, (size2 - result.mirrored_units - result.inside_units - result.outside_units) * params.samples * params.samples);
+
+    return record;
+}
+
+inline result_record make_fixedtime_record(const host_info& host, const run_params& params, const std::string& shape,
+    const long long time, const int run, const int runs, const fixedtime_run_result& result)
+{
+    result_record record;
+
+    add_host_fields(record, host);
+    add_param_fields(record, params, "fixedtime", shape, time, run, runs);
+
+    record.add("score", result.score());
+    record.add("total_time_ns", result.time);
+    record.add_empty("sum_unit_time_ns");
+    record.add_empty("best_unit_time_ns");
+    record.add_empty("unit_p50_ns");
+    record.add_empty("unit_p90_ns");
+    record.add_empty("unit_p99_ns");
+    record.add_empty("unit_max_ns");
+    record.add_empty("inside_units");
+    record.add_empty("outside_units");
+    record.add_empty("mirrored_units");
+    record.add_empty("avg_value");
+    record.add("units_processed", result.count);
+
+    if (result.timeline_units.empty())
+    {
+        record.add_empty("early_units_per_s");
+        record.add_empty("late_units_per_s");
+        record.add_empty("throttled");
+        record.add_empty("timeline_units");
+    }
+    else
+    {
+        // Completed units per interval separated by spaces, the last interval may be shorter
+        std::string timeline;
+        for (size_t i = 0; i < result.timeline_units.size(); i++)
+            timeline += (i > 0 ? " " : "") + std::to_string(result.timeline_units[i]);
+
+        record.add("early_units_per_s", result.trend.early_rate);
+        record.add("late_units_per_s", result.trend.late_rate);
+        record.add("throttled", result.trend.throttled);
+        record.add("timeline_units", timeline);
+    }
+
+    record.add_empty("passes");
+    record.add_empty("first_preview_ns");
+    record.add_empty("final_ns");
+    record.add_empty("graph_bytes");
+    record.add_empty("reduce_ns");
+    record.add_empty("image_write_ns");
+    record.add_empty("image_stall_ns");
+    record.add_empty("image_flush_ns");
+
+    add_graph_memory_fields(record, result.memory);
+
+    add_counter_fields(record, result.counters, (double)result.count * params.samples * params.samples);
+
+    return record;
+}
+
+// Loop statistics appended to each run record once the loop has finished
+inline void add_summary_fields(result_record& record, const score_summary& summary, const int run)
+{
+    record.add("outlier", (bool)summary.outlier[run]);
+    record.add("warmup_runs", summary.warmup_runs);
+    record.add("loop_score", summary.score);
+    record.add("score_mean", summary.mean);
+    record.add("score_median", summary.median);
+    record.add("score_stddev", summary.stddev);
+    record.add("score_ci95_low", summary.ci_low);
+    record.add("score_ci95_high", summary.ci_high);
+}
+
+// One point of a thread scaling sweep, params carry the point's threads and placement.
+// Scaling records have no run index, the score is the one returned by the loop.
+inline result_record make_scaling_record(const host_info& host, const run_params& params, const std::string& bench, const std::string& shape,
+    const long long time, const scaling_point& point, const scaling_curve& curve)
+{
+    result_record record;
+
+    add_host_fields(record, host);
+    add_param_fields(record, params, bench, shape, time, -1, point.runs);
+
+    record.add("score", point.score);
+    record.add("score_relative_ci95", point.relative_ci);
+    record.add("speedup", point.speedup);
+    record.add("efficiency", point.efficiency);
+    record.add("serial_fraction", point.serial_fraction);
+    record.add("amdahl_serial_fraction", curve.amdahl_serial_fraction);
+
+    return record;
+}
+
+// One precision mode of a precision sweep, params carry the mode
+inline result_record make_precision_record(const host_info& host, const run_params& params, const std::string& bench, const std::string& shape,
+    const long long time, const precision_point& point)
+{
+    result_record record;
+
+    add_host_fields(record, host);
+    add_param_fields(record, params, bench, shape, time, -1, point.runs);
+
+    record.add("score", point.score);
+    record.add("score_relative_ci95", point.relative_ci);
+    record.add("relative_throughput", point.relative_throughput);
+    record.add("max_unit_error", point.max_unit_error);
+    record.add("mismatched_units", point.mismatched_units);
+    record.add("correct", point.correct);
+
+    return record;
+}
+
+// One configuration of an autotune search, params carry the configuration. best marks the winner of the shape.
+inline result_record make_tuning_record(const host_info& host, const run_params& params, const std::string& shape, const score_summary& summary,
+    const bool best)
+{
+    result_record record;
+
+    add_host_fields(record, host);
+    add_param_fields(record, params, "tune", shape, 0, -1, summary.runs());
+
+    record.add("score", summary.score);
+    record.add("score_relative_ci95", summary.relative_ci());
+    record.add("best", best);
+
+    return record;
+}
+
+// One shape of a batched run, params carry the shape
+inline result_record make_batch_record(const host_info& host, const run_params& params, const std::string& shape, const int run, const int runs,
+    const batch_run_result& result, const batch_shape_result& shape_result)
+{
+    result_record record;
+
+    add_host_fields(record, host);
+    add_param_fields(record, params, "batch", shape, 0, run, runs);
+
+    record.add("score", result.batch.score());
+    record.add("batch_shapes", (int)result.shapes.size());
+    record.add("batch_ns", result.batch.total_time);
+    record.add("separate_ns", shape_result.separate_time);
+    record.add("separate_total_ns", result.separate_total_time);
+    record.add("batch_speedup", result.speedup());
+    record.add("avg_value", shape_result.avg_value);
+    record.add("matches_separate", shape_result.matches);
+
+    return record;
+}
+
+// One record per animation run, params hold the path's first keyframe
+inline result_record make_animation_record(const host_info& host, const run_params& params, const std::string& shape,
+    const std::vector<view_keyframe>& path, const int run, const int runs, const animation_run_result& result)
+{
+    result_record record;
+
+    add_host_fields(record, host);
+    add_param_fields(record, params, "animation", shape, 0, run, runs);
+
+    record.add("score", result.score());
+    record.add("path", format_path(path));
+    record.add("frames", result.frames);
+    record.add("frames_in_flight", result.frames_in_flight);
+    record.add("total_time_ns", result.render.total_time);
+    record.add("frames_per_s", result.frames_per_second());
+    record.add("frame_p50_ns", result.frame_latency.percentile(50));
+    record.add("frame_p90_ns", result.frame_latency.percentile(90));
+    record.add("frame_p99_ns", result.frame_latency.percentile(99));
+    record.add("frame_max_ns", result.frame_latency.max);
+    record.add("buffer_stall_ns", result.stall_time);
+    record.add("inside_units", result.render.inside_units);
+    record.add("outside_units", result.render.outside_units);
+    record.add("avg_value", result.render.avg_value);
+
+    add_graph_memory_fields(record, result.render.memory);
+
+    return record;
+}
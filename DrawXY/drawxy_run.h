@@ -2,161 +2,617 @@
 
 #include <iostream>
 #include <numeric>
+#include <functional>
+#include <vector>
+#include <algorithm>
+#include <chrono>
 
 #include "drawxy_common.h"
+#include "drawxy_dispatch.h"
 #include "drawxy_graph_funcs.h"
 #include "drawxy_structs.h"
+#include "drawxy_shape_dsl.h"
 
-constexpr float scale_x = 4.0;
-constexpr float scale_y = 4.0;
-constexpr float offset_x = -2.0;
-constexpr float offset_y = -2.0;
 constexpr float threshold = 0.5;
 
-template <graph_shape shape> multisample_run_result run_multisample_single(const run_params params)
+// Programs have no double or mixed precision interpreter
+inline precision_mode effective_precision(const run_params& params)
 {
+    return params.program != nullptr ? precision_mode::SINGLE : params.precision;
+}
+
+// The interpreter for a shape program, otherwise the best compiled kernel for the shape and precision
+inline unit_kernel select_unit_kernel(const run_params& params)
+{
+    if (params.program != nullptr)
+        return unit_kernel(select_calc_program(params.vec_level), params.program);
+
+    if (is_escape_shape(params.shape))
+        return unit_kernel(select_calc_escape(params.vec_level, params.precision, params.shape), params.max_iterations);
+
+    if (params.precision != precision_mode::SINGLE)
+        return select_calc_avg_precise(params.vec_level, params.precision, params.shape);
+
+    if (params.kernel == sampling_kernel::ROW_SWEEP && row_sweep_variant(params.accumulators) >= 0)
+        return select_calc_avg_rows_variant(params.vec_level, row_sweep_variant(params.accumulators), params.shape);
+
+    return select_calc_avg(params.vec_level, params.kernel, params.shape);
+}
+
+// Console report of the run functions, discarded for quiet runs
+inline std::ostream& report_stream(const run_params& params)
+{
+    static std::ostream discard(nullptr);
+    return params.verbose ? std::cout : discard;
+}
+
+// Called with the index and result of every run of a loop
+typedef std::function<void(int run, const multisample_run_result& result)> multisample_callback;
+typedef std::function<void(int run, const fixedtime_run_result& result)> fixedtime_callback;
+
+// Pins the pool workers for the run's placement, or releases them. Pooled graphs first touched
+// under another placement or page mode are unmapped, their pages sit on the old workers' nodes.
+inline void apply_placement(const run_params& params)
+{
+    get_thread_pool().pin(placement_cpus(get_cpu_topology(), params.placement, params.threads));
+    get_graph_pool().configure(params.huge_pages, params.graph_pool, (int)params.placement);
+}
+
+// Graph memory lines of a run: time to map or reuse blocks and to fault their pages in
+inline void print_graph_memory(std::ostream& out, const graph_memory_stats& memory)
+{
+    if (memory.blocks == 0)
+    {
+        out << "Graph alloc time:     none, graphs kept from the previous run" << std::endl;
+        return;
+    }
+
+    out << "Graph alloc time:     " << memory.alloc_time / 1e6 << " ms (" << memory.reused_blocks << " of " << memory.blocks
+        << (memory.blocks == 1 ? " block" : " blocks") << " reused from the pool)" << std::endl;
+    out << "Graph first touch:    " << memory.touch_time / 1e6 << " ms, ";
+
+    if (memory.page_faults >= 0)
+        out << memory.page_faults << " page faults" << std::endl;
+    else
+        out << "page faults not reported by this OS" << std::endl;
+
+    out << "Huge pages:           " << huge_page_mode_to_string(memory.mode);
+
+    if (memory.mode != huge_page_mode::NONE)
+        out << (memory.huge ? ", in effect" : ", not in effect");
+
+    if (!memory.error.empty())
+        out << " (" << memory.error << ")";
+
+    out << std::endl;
+}
+
+inline std::string shape_name(const run_params& params)
+{
+    if (params.program != nullptr)
+        return "\"" + params.program->source + "\" (program)";
+
+    return graph_shape_to_string(params.shape);
+}
+
+inline std::string kernel_name(const run_params& params)
+{
+    if (params.program != nullptr)
+        return "Program interpreter";
+
+    // Double and mixed precision and escape-time kernels always sweep rows
+    if (params.precision != precision_mode::SINGLE || is_escape_shape(params.shape))
+        return sampling_kernel_to_string(sampling_kernel::ROW_SWEEP);
+
+    if (params.kernel == sampling_kernel::SPAN && !select_span(params.vec_level, params.shape))
+        return sampling_kernel_to_string(sampling_kernel::ROW_SWEEP) + " (no spans for this shape)";
+
+    if (params.kernel == sampling_kernel::LATTICE && !select_lattice(params.vec_level, params.shape))
+        return sampling_kernel_to_string(sampling_kernel::ROW_SWEEP) + " (no lattice form for this shape)";
+
+    if (params.kernel == sampling_kernel::ROW_SWEEP && params.accumulators > 0)
+        return sampling_kernel_to_string(params.kernel) + ", " + std::to_string(params.accumulators) + " accumulators";
+
+    return sampling_kernel_to_string(params.kernel);
+}
+
+// Kernels that evaluate the diagonal image of every sample of a unit, so units mirrored across the
+// diagonal are exact. The vector flat index kernels derive x and y from the sample index in
+// different ways and mixed precision sums the offset terms in x, y order.
+inline bool diagonal_exact(const run_params& params)
+{
+    if (params.precision == precision_mode::MIXED)
+        return false;
+
+    return params.precision != precision_mode::SINGLE || is_escape_shape(params.shape)
+        || params.kernel != sampling_kernel::FLAT_INDEX || params.vec_level == vectorization_level::NONE;
+}
+
+// Axis mirrors are corrected on the integer lattice, where the lattice kernel renders the shape
+inline bool lattice_mirrors(const run_params& params)
+{
+    return params.precision == precision_mode::SINGLE && !is_escape_shape(params.shape) && params.kernel == sampling_kernel::LATTICE
+        && select_lattice(params.vec_level, params.shape) && params.samples <= lattice_mirror_max_samples;
+}
+
+// Runs loop.warmup unreported runs, then count measured runs. With a target CI, measuring
+// continues until the interval is narrow enough or loop.max_runs is reached. run(i) performs
+// measured run i, or a warmup run for i < 0, and returns its score.
+template <typename F> score_summary repeat_runs(const run_params& params, const int count, F run)
+{
+    const loop_policy& loop = params.loop;
+    std::ostream& out = report_stream(params);
+
+    for (int i = 0; i < loop.warmup; i++)
+    {
+        out << "Warmup " << i + 1 << "/" << loop.warmup << std::endl;
+        run(-1);
+    }
+
+    const int max_runs = loop.target_ci > 0.0 ? std::max(count, loop.max_runs) : count;
+
+    std::vector<long long> scores;
+    score_summary summary;
+
+    for (int i = 0; i < max_runs; i++)
+    {
+        scores.push_back(run(i));
+
+        if (i + 1 < count)
+            continue;
+
+        summary = summarize_scores(scores, loop.outlier_k, loop.statistic);
+
+        if (loop.target_ci <= 0.0 || (summary.runs() - summary.outliers >= 2 && summary.relative_ci() <= loop.target_ci))
+            break;
+    }
+
+    summary.warmup_runs = loop.warmup;
+
+    return summary;
+}
+
+inline void print_score_summary(std::ostream& out, const run_params& params, const score_summary& summary)
+{
+    out << "Score:                " << summary.score << std::endl;
+    out << "Score statistic:      " << score_statistic_to_string(params.loop.statistic) << std::endl;
+    out << "Measured runs:        " << summary.runs() << " (" << summary.warmup_runs << " warmup, " << summary.outliers << " outliers)" << std::endl;
+    out << "Mean score:           " << summary.mean << std::endl;
+    out << "Median score:         " << summary.median << std::endl;
+    out << "Score stddev:         " << summary.stddev << " (" << (summary.mean > 0 ? summary.stddev / summary.mean * 100 : 0.0) << "%)" << std::endl;
+    out << "Score 95% CI:         " << summary.ci_low << " - " << summary.ci_high << " (+-" << summary.relative_ci() * 100 << "%)" << std::endl;
+    out << "Max score:            " << summary.max << std::endl;
+
+    if (params.loop.target_ci > 0.0 && summary.relative_ci() > params.loop.target_ci)
+        out << "CI target of +-" << params.loop.target_ci * 100 << "% not reached in " << summary.runs() << " runs" << std::endl;
+}
+
+// Hardware counter lines of a run, samples is the number of samples the counted kernel calls evaluated
+inline void print_counters(std::ostream& out, const perf_counts& counters, const std::string& error, const double samples)
+{
+    if (!counters.valid)
+    {
+        out << "Counters:             unavailable (" << (error.empty() ? "no kernel calls counted" : error) << ")" << std::endl;
+        return;
+    }
+
+    const double per_k_instr = counters.instructions > 0 ? 1000.0 / counters.instructions : 0.0;
+
+    out << "Cycles:               " << counters.cycles << std::endl;
+    out << "Instructions:         " << counters.instructions << " (IPC " << counters.ipc() << ")" << std::endl;
+    out << "Samples/cycle:        " << (counters.cycles > 0 ? samples / counters.cycles : 0.0) << std::endl;
+
+    if (counters.fp_valid)
+    {
+        out << "FP instructions:      " << counters.fp_instructions() << " (" << (counters.cycles > 0 ? counters.flops() / counters.cycles : 0.0)
+            << " FLOPs/cycle, " << (samples > 0 ? counters.flops() / samples : 0.0) << " FLOPs/sample)" << std::endl;
+    }
+    else
+    {
+        out << "FP instructions:      unavailable" << std::endl;
+    }
+
+    out << "Cache misses:         " << counters.cache_misses << " (" << counters.cache_misses * per_k_instr << " per 1k instructions)" << std::endl;
+    out << "Branch misses:        " << counters.branch_misses << " (" << counters.branch_misses * per_k_instr << " per 1k instructions)" << std::endl;
+}
+
+// graph receives the coverage of every unit when given, on_pass each pass of a progressive render
+inline multisample_run_result run_multisample_single(const run_params params, std::vector<float>* graph_out = nullptr,
+    const progressive_callback& on_pass = nullptr)
+{
+    std::ostream& out = report_stream(params);
+
     const auto size2 = params.size * params.size;
 
     multisample_run_result result;
-    std::vector<float> graph(size2);
+    coverage_buffer graph(params.coverage);
+
+    // Programs have no interval bounds, so they are never culled
+    const unit_kernel calc = select_unit_kernel(params);
+    const classify_func classify = params.cull == cull_mode::INTERVAL && params.program == nullptr ? select_classify(params.vec_level, params.shape) : nullptr;
+
+    apply_placement(params);
+
+    // Callers that want the graph get it in memory, the image is only written by tiled renders
+    const int in_flight = params.tiles_in_flight > 0 ? params.tiles_in_flight : 2 * params.threads;
+    tiled_image_writer writer(params.image_path, params.image, (int)params.size, params.tile_size, in_flight);
+
+    bool tiled = !params.image_path.empty() && graph_out == nullptr;
+
+    const bool progressive = params.progressive && !tiled;
 
-    if (params.vec_level == vectorization_level::NONE)
+    // Programs do not declare symmetries. Tiled renders compute every unit, mirrored units would
+    // often sit in tiles that were already written.
+    const symmetry_group symmetry = params.symmetry && params.program == nullptr && !progressive && diagonal_exact(params)
+        ? view_symmetry(select_symmetry(params.vec_level, params.shape), params.view_scale(), params.view_scale(), params.view_offset_x(), params.view_offset_y(),
+            lattice_mirrors(params))
+        : symmetry_group();
+
+    // An image that cannot be created is reported and the run falls back to an in memory graph
+    if (tiled && !writer.open())
     {
-        result = graph_multisample_mt<vectorization_level::NONE, shape>(params.size, params.samples, scale_x, scale_y, offset_x, offset_y, params.threads, graph);
+        std::cerr << writer.error << std::endl;
+        tiled = false;
+    }
+
+    if (tiled)
+    {
+        result = graph_multisample_tiled(calc, classify, params.size, params.samples, params.view_scale(), params.view_scale(),
+            params.view_offset_x(), params.view_offset_y(), params.threads, params.tile_size, writer,
+            params.counters);
+
+        auto flush_begin_time = std::chrono::steady_clock::now();
+
+        if (!writer.finish())
+            std::cerr << writer.error << std::endl;
+
+        auto flush_end_time = std::chrono::steady_clock::now();
+
+        result.io_write_time = writer.write_time;
+        result.io_stall_time = writer.stall_time;
+        result.io_flush_time = std::chrono::duration_cast<std::chrono::nanoseconds>(flush_end_time - flush_begin_time).count();
+        result.peak_tiles_in_flight = writer.peak_in_flight;
     }
     else
     {
-        result = graph_multisample_mt<vectorization_level::AVX2, shape>(params.size, params.samples, scale_x, scale_y, offset_x, offset_y, params.threads, graph);
+        if (progressive)
+        {
+            const progressive_callback report_pass = [&](const progressive_pass& pass, const coverage_buffer& preview)
+            {
+                out << "  Pass " << pass.index + 1 << "/" << pass.passes << ":          " << pass.samples << " samples/axis, "
+                    << pass.block << "x" << pass.block << " blocks, " << pass.time / 1e6 << " ms" << std::endl;
+
+                if (on_pass)
+                    on_pass(pass, preview);
+            };
+
+            result = graph_multisample_progressive(calc, classify, params.size, params.samples, params.view_scale(), params.view_scale(),
+                params.view_offset_x(), params.view_offset_y(), params.threads, params.grain, graph,
+                report_pass, params.counters);
+        }
+        else
+        {
+            result = graph_multisample_mt(calc, classify, params.size, params.samples, params.view_scale(), params.view_scale(),
+                params.view_offset_x(), params.view_offset_y(), params.threads, params.grain, graph,
+                symmetry, params.counters, lattice_mirrors(params) ? select_lattice_mirror(params.vec_level, params.shape) : nullptr);
+        }
+
+        // The mean is reduced from the stored, possibly quantized values
+        const coverage_sum_func coverage_sum = select_coverage_sum(params.vec_level, params.coverage);
+
+        auto reduce_begin_time = std::chrono::steady_clock::now();
+
+        const double sum = coverage_sum(graph.data(), graph.size());
+
+        auto reduce_end_time = std::chrono::steady_clock::now();
+
+        result.avg_value = (float)(sum / coverage_format_max(params.coverage) / size2);
+        result.graph_bytes = graph.bytes();
+        result.reduce_time = std::chrono::duration_cast<std::chrono::nanoseconds>(reduce_end_time - reduce_begin_time).count();
     }
 
-    auto avg_value = std::accumulate(graph.begin(), graph.end(), 0.f) / size2;
+    auto avg_value = result.avg_value;
 
+    // Only sampled units are timed, fewer of them than threads cannot keep every worker busy
+    const long long sampled_units = result.unit_latency.count;
+    const long long busy_threads = std::max(1LL, std::min((long long)params.threads, sampled_units));
 
+    auto est_mt_time = result.sum_single_time / busy_threads;
+    auto overhead = est_mt_time > 0 ? (float) (result.total_time - est_mt_time) / est_mt_time * 100 : 0.0f;
+    // Mirrored and culled units evaluate no samples
+    const long long evaluated_units = size2 - result.mirrored_units - result.inside_units - result.outside_units;
 
-    auto est_mt_time = result.sum_single_time / params.threads;
-    auto overhead = (float) (result.total_time - est_mt_time) / est_mt_time * 100;
-    auto perf = params.total_calculations() * 1e9 / result.total_time;
+    auto perf = (double)evaluated_units * params.samples * params.samples * 1e9 / result.total_time;
     auto score = result.score();
 
-    std::cout << "Score:                " << score << std::endl;
-    std::cout << "Total time:           " << result.total_time / 1e6 << " ms" << std::endl;
-    std::cout << "Avg time/unit:        " << result.sum_single_time / size2 / 1e6 << " ms" << std::endl;
-    std::cout << "Best time/unit:       " << result.best_single_time / 1e6 << " ms" << std::endl;
-    std::cout << "ST total time:        " << result.sum_single_time / 1e6 << " ms" << std::endl;
-    std::cout << "Est MT total time:    " << est_mt_time / 1e6 << " ms" << std::endl;
-    std::cout << "Overhead:             " << overhead << "%" << std::endl;
-    std::cout << "Avg value:            " << avg_value << std::endl;
-    std::cout << "Performance:          " << perf << " calc/s" << std::endl;
-    std::cout << std::endl;
+    out << "Score:                " << score << std::endl;
+    out << "Total time:           " << result.total_time / 1e6 << " ms" << std::endl;
+
+    if (progressive)
+    {
+        out << "Time to preview:      " << result.first_preview_time / 1e6 << " ms" << std::endl;
+        out << "Time to final:        " << result.total_time / 1e6 << " ms (" << result.passes << " passes)" << std::endl;
+    }
+
+    out << "Avg time/unit:        " << (sampled_units > 0 ? result.sum_single_time / sampled_units : 0) / 1e6 << " ms" << std::endl;
+    out << "Best time/unit:       " << result.best_single_time / 1e6 << " ms" << std::endl;
+    out << "ST total time:        " << result.sum_single_time / 1e6 << " ms" << std::endl;
+    out << "Est MT total time:    " << est_mt_time / 1e6 << " ms" << std::endl;
+    out << "Overhead:             " << overhead << "%" << std::endl;
+    out << "Avg value:            " << avg_value << std::endl;
+    out << "Performance:          " << perf << " calc/s" << std::endl;
+
+    if (!tiled)
+    {
+        out << "Coverage format:      " << coverage_format_to_string(params.coverage) << std::endl;
+        out << "Graph memory:         " << result.graph_bytes / 1e6 << " MB" << std::endl;
+        out << "Graph write rate:     " << result.graph_bytes / (double)result.total_time << " GB/s" << std::endl;
+        out << "Reduction time:       " << result.reduce_time / 1e6 << " ms" << std::endl;
+        out << "Reduction bandwidth:  " << (result.reduce_time > 0 ? result.graph_bytes / (double)result.reduce_time : 0.0) << " GB/s" << std::endl;
+        print_graph_memory(out, result.memory);
+    }
+    else
+    {
+        out << "Image:                " << params.image_path << " (" << image_format_to_string(params.image) << ", "
+            << params.tile_size << "x" << params.tile_size << " tiles)" << std::endl;
+        out << "Image write time:     " << result.io_write_time / 1e6 << " ms" << std::endl;
+        out << "Image stall time:     " << result.io_stall_time / 1e6 << " ms" << std::endl;
+        out << "Image flush time:     " << result.io_flush_time / 1e6 << " ms" << std::endl;
+        out << "Peak tiles in flight: " << result.peak_tiles_in_flight << std::endl;
+    }
+
+    if (classify != nullptr)
+    {
+        out << "Skipped units:        " << result.inside_units + result.outside_units << " / " << size2
+            << " (" << result.inside_units << " inside, " << result.outside_units << " outside)" << std::endl;
+    }
+
+    if (!tiled)
+    {
+        out << "Symmetry:             " << symmetry_group_to_string(symmetry);
+
+        if (symmetry.any())
+            out << " (" << result.mirrored_units << " / " << size2 << " units mirrored)";
+
+        out << std::endl;
+    }
+
+    if (params.counters)
+        print_counters(out, result.counters, result.counter_error,
+            (double)evaluated_units * params.samples * params.samples);
+
+    const auto& latency = result.unit_latency;
+
+    out << "Unit time p50:        " << latency.percentile(50) / 1e6 << " ms" << std::endl;
+    out << "Unit time p90:        " << latency.percentile(90) / 1e6 << " ms" << std::endl;
+    out << "Unit time p99:        " << latency.percentile(99) / 1e6 << " ms" << std::endl;
+    out << "Unit time max:        " << latency.max / 1e6 << " ms" << std::endl;
+
+    // Imbalance: spread of busy time across workers relative to the average
+    long long min_busy = INT64_MAX;
+    long long max_busy = 0;
+    long long sum_busy = 0;
+
+    for (const auto& ts : result.per_thread)
+    {
+        min_busy = ts.busy_time < min_busy ? ts.busy_time : min_busy;
+        max_busy = ts.busy_time > max_busy ? ts.busy_time : max_busy;
+        sum_busy += ts.busy_time;
+    }
+
+    auto avg_busy = (double)sum_busy / params.threads;
+    auto imbalance = avg_busy > 0 ? (max_busy - min_busy) / avg_busy * 100 : 0.0;
+
+    out << "Thread imbalance:     " << imbalance << "%" << std::endl;
+
+    for (int t = 0; t < (int)result.per_thread.size(); t++)
+    {
+        const auto& ts = result.per_thread[t];
+
+        out << "  Thread " << t << ":           " << ts.units << " units, busy " << ts.busy_time / 1e6
+            << " ms, idle " << (result.total_time - ts.busy_time) / 1e6 << " ms";
+
+        if (ts.counters.valid)
+            out << ", IPC " << ts.counters.ipc();
+
+        out << std::endl;
+    }
+
+    out << std::endl;
+
+    if (graph_out != nullptr)
+        *graph_out = graph.to_float();
 
 #ifdef PRINT_RESULT
-    for (int y = size - 1; y >= 0; y--)
+    for (long long y = graph.size() == 0 ? -1 : params.size - 1; y >= 0; y--)
     {
-        for (int x = 0; x < size; x++)
+        for (long long x = 0; x < params.size; x++)
         {
-            std::cout << (result.graph[x + y * size] > threshold ? "X " : ". ");
+            out << (graph.load(x + y * params.size) > threshold ? "X " : ". ");
         }
-        std::cout << std::endl;
+        out << std::endl;
     }
-    std::cout << std::endl;
+    out << std::endl;
 #endif
     
     return result;
 }
 
-template <graph_shape shape> long long run_multisample_loop(const run_params params, const int count)
-{
-    std::cout << "Multisample Benchmark" << std::endl;
-    std::cout << "Shape:                " << graph_shape_to_string(shape) << std::endl;
-    std::cout << "Vectorization level:  " << vec_level_to_string(params.vec_level) << std::endl;
-    std::cout << "Samples Per Unit:     " << params.samples << std::endl;
-    std::cout << "Display Size:         " << params.size << std::endl;
-    std::cout << "Threads:              " << params.threads << std::endl;
-    std::cout << "Total Calculations:   " << params.total_calculations() << std::endl;
-    std::cout << "Runs:                 " << count << std::endl;
-    std::cout << std::endl;
-    
-    long long hi_score = 0;
+inline score_summary run_multisample_loop(const run_params params, const int count, const multisample_callback& on_run = nullptr)
+{
+    std::ostream& out = report_stream(params);
+
+    out << "Multisample Benchmark" << std::endl;
+    out << "Shape:                " << shape_name(params) << std::endl;
+    out << "Vectorization level:  " << vec_level_to_string(params.vec_level) << std::endl;
+    out << "Sampling kernel:      " << kernel_name(params) << std::endl;
+    out << "Precision:            " << precision_mode_to_string(effective_precision(params)) << std::endl;
+    out << "View:                 zoom " << params.zoom << " at (" << params.center_x << ", " << params.center_y << ")" << std::endl;
+
+    if (params.program == nullptr && is_escape_shape(params.shape))
+        out << "Max iterations:       " << params.max_iterations << std::endl;
+
+    out << "Unit culling:         " << cull_mode_to_string(params.program != nullptr ? cull_mode::NONE : params.cull) << std::endl;
+    out << "Samples Per Unit:     " << params.samples << std::endl;
+    out << "Display Size:         " << params.size << std::endl;
+    out << "Threads:              " << params.threads << std::endl;
+    out << "Thread placement:     " << thread_placement_to_string(params.placement) << std::endl;
+    out << "Graph pool:           " << (params.graph_pool ? "On [graphs reused across runs]" : "Off [every run maps and faults its graphs]") << std::endl;
+    out << "Chunk grain:          " << params.grain << " units" << std::endl;
+    out << "Total Calculations:   " << params.total_calculations() << std::endl;
+    out << "Runs:                 " << count << std::endl;
+    out << "Warmup runs:          " << params.loop.warmup << std::endl;
+    out << "Hardware counters:    " << (params.counters ? "On" : "Off") << std::endl;
+    out << std::endl;
 
     long long sum_time = 0;
     long long best_time = INT64_MAX;
+    int measured = 0;
 
-    for (int i = 0; i < count; i++)
+    const score_summary summary = repeat_runs(params, count, [&](int i)
     {
-        auto result = run_multisample_single<shape>(params);
+        auto result = run_multisample_single(params);
         auto score = result.score();
 
-        hi_score = score > hi_score ? score : hi_score;
+        if (i < 0)
+            return score;
+
+        if (on_run)
+            on_run(i, result);
 
         sum_time += result.total_time;
         best_time = result.total_time < best_time ? result.total_time : best_time;
-    }
+        measured++;
+
+        return score;
+    });
 
-    long long avg_time = sum_time / count;
+    long long avg_time = sum_time / measured;
 
-    std::cout << "Loop finished" << std::endl;
-    std::cout << "Score:                " << hi_score << std::endl;
-    std::cout << "Avg time:             " << avg_time / 1e6 << " ms" << std::endl;
-    std::cout << "Best time:            " << best_time / 1e6 << " ms" << std::endl;
-    std::cout << std::endl;
+    out << "Loop finished" << std::endl;
+    print_score_summary(out, params, summary);
+    out << "Avg time:             " << avg_time / 1e6 << " ms" << std::endl;
+    out << "Best time:            " << best_time / 1e6 << " ms" << std::endl;
+    out << std::endl;
 
-    return hi_score;
+    return summary;
 };
 
-template <graph_shape shape> fixedtime_run_result run_fixedtime_single(const run_params params, const long long time)
+inline fixedtime_run_result run_fixedtime_single(const run_params params, const long long time)
 {
+    std::ostream& out = report_stream(params);
+
     const auto size2 = params.size * params.size;
 
     fixedtime_run_result result;
 
-    if (params.vec_level == vectorization_level::NONE)
-    {
-        result = graph_fixedtime_mt<vectorization_level::NONE, shape>(params.size, params.samples, scale_x, scale_y, offset_x, offset_y, params.threads, time);
-    }
-    else
-    {
-        result = graph_fixedtime_mt<vectorization_level::AVX2, shape>(params.size, params.samples, scale_x, scale_y, offset_x, offset_y, params.threads, time);
-    }
+    const unit_kernel calc = select_unit_kernel(params);
+
+    apply_placement(params);
+
+    result = graph_fixedtime_mt(calc, params.size, params.samples, params.view_scale(), params.view_scale(),
+        params.view_offset_x(), params.view_offset_y(), params.threads, params.grain, time,
+        params.timeline_interval, params.counters);
+
+    result.trend = analyze_throughput(result.timeline_units, result.timeline_time, params.throttle_threshold);
     
     auto score = result.score();
 
-    std::cout << "Score:                " << score << std::endl;
-    std::cout << "Units prcoessed:      " << result.count << std::endl;
-    std::cout << "Precise time:         " << result.time / 1e6 << " ms" << std::endl;
-    std::cout << std::endl;
+    out << "Score:                " << score << std::endl;
+    out << "Units prcoessed:      " << result.count << std::endl;
+    out << "Precise time:         " << result.time / 1e6 << " ms" << std::endl;
+    print_graph_memory(out, result.memory);
+
+    if (params.counters)
+        print_counters(out, result.counters, result.counter_error, (double)result.count * params.samples * params.samples);
+
+    if (!result.timeline_units.empty())
+    {
+        // Completed units per second of each interval, 10 intervals per line
+        out << "Timeline (units/s):   every " << params.timeline_interval << " ms" << std::endl;
+
+        for (size_t i = 0; i < result.timeline_units.size(); i++)
+        {
+            const long long t = result.timeline_time[i];
+
+            if (i % 10 == 0)
+                out << "  " << i * params.timeline_interval << " ms:";
+
+            out << " " << (t > 0 ? (long long)(result.timeline_units[i] * 1e9 / t) : 0);
+
+            if (i % 10 == 9 || i + 1 == result.timeline_units.size())
+                out << std::endl;
+        }
+
+        out << "Early throughput:     " << result.trend.early_rate << " units/s" << std::endl;
+        out << "Late throughput:      " << result.trend.late_rate << " units/s" << std::endl;
+        out << "Throughput change:    " << result.trend.change * 100 << "%" << (result.trend.throttled ? " [THROTTLING]" : "") << std::endl;
+    }
+
+    out << std::endl;
 
     return result;
 }
 
-template <graph_shape shape> long long run_fixedtime_loop(const run_params params, const long long time, const int count)
+inline score_summary run_fixedtime_loop(const run_params params, const long long time, const int count, const fixedtime_callback& on_run = nullptr)
 {
-    std::cout << "Fixed Time Benchmark" << std::endl;
-    std::cout << "Shape:                " << graph_shape_to_string(shape) << std::endl;
-    std::cout << "Vectorization level:  " << vec_level_to_string(params.vec_level) << std::endl;
-    std::cout << "Threads:              " << params.threads << std::endl;
-    std::cout << "Time:                 " << time << " ms" << std::endl;
-    std::cout << std::endl;
-    
-    long long hi_score = 0;
+    std::ostream& out = report_stream(params);
+
+    out << "Fixed Time Benchmark" << std::endl;
+    out << "Shape:                " << shape_name(params) << std::endl;
+    out << "Vectorization level:  " << vec_level_to_string(params.vec_level) << std::endl;
+    out << "Sampling kernel:      " << kernel_name(params) << std::endl;
+    out << "Precision:            " << precision_mode_to_string(effective_precision(params)) << std::endl;
+    out << "View:                 zoom " << params.zoom << " at (" << params.center_x << ", " << params.center_y << ")" << std::endl;
+
+    if (params.program == nullptr && is_escape_shape(params.shape))
+        out << "Max iterations:       " << params.max_iterations << std::endl;
 
-    for (int i = 0; i < count; i++)
+    out << "Threads:              " << params.threads << std::endl;
+    out << "Thread placement:     " << thread_placement_to_string(params.placement) << std::endl;
+    out << "Graph pool:           " << (params.graph_pool ? "On [graphs reused across runs]" : "Off [every run maps and faults its graphs]") << std::endl;
+    out << "Chunk grain:          " << params.grain << " units" << std::endl;
+    out << "Time:                 " << time << " ms" << std::endl;
+    out << "Timeline interval:    " << params.timeline_interval << " ms" << std::endl;
+    out << "Warmup runs:          " << params.loop.warmup << std::endl;
+    out << "Hardware counters:    " << (params.counters ? "On" : "Off") << std::endl;
+    out << std::endl;
+
+    int throttled = 0;
+    int measured = 0;
+
+    const score_summary summary = repeat_runs(params, count, [&](int i)
     {
-        std::cout << "Run " << i + 1 << "/" << count << std::endl;
-        
-        auto result = run_fixedtime_single<shape>(params, time);
+        if (i >= 0)
+        {
+            out << "Run " << i + 1;
+            if (params.loop.target_ci <= 0.0)
+                out << "/" << count;
+            out << std::endl;
+        }
+
+        auto result = run_fixedtime_single(params, time);
         auto score = result.score();
 
-        if (score > hi_score)
+        if (i >= 0)
         {
-            hi_score = score;
+            throttled += result.trend.throttled;
+            measured++;
         }
-        
-    }
 
-    std::cout << "Loop finished" << std::endl;
-    std::cout << "Score:                " << hi_score << std::endl;
-    std::cout << std::endl;
+        if (i >= 0 && on_run)
+            on_run(i, result);
 
-    return hi_score;
-};
+        return score;
+    });
+
+    out << "Loop finished" << std::endl;
+    print_score_summary(out, params, summary);
+
+    if (params.timeline_interval > 0)
+        out << "Throttled runs:       " << throttled << " / " << measured << std::endl;
 
+    out << std::endl;
+
+    return summary;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <functional>
+
+#include "drawxy_common.h"
+#include "drawxy_structs.h"
+#include "drawxy_graph_funcs.h"
+#include "drawxy_run.h"
+#include "drawxy_topology.h"
+
+struct scaling_point
+{
+    int threads;
+    int runs;
+    long long score;
+
+    // Half width of the score's 95% confidence interval relative to its mean
+    double relative_ci;
+
+    // Relative to the 1 thread score of the same placement
+    double speedup;
+    double efficiency;
+
+    // Karp-Flatt metric, the serial fraction implied by this point alone (0 at 1 thread)
+    double serial_fraction;
+};
+
+struct scaling_curve
+{
+    thread_placement placement;
+    std::vector<scaling_point> points;
+
+    // Least squares fit of Amdahl's law speedup = 1 / (f + (1 - f) / n) over all points
+    double amdahl_serial_fraction;
+};
+
+// 1, 2, 4, ... below max_threads, then max_threads itself
+inline std::vector<int> scaling_thread_counts(int max_threads)
+{
+    std::vector<int> counts;
+
+    for (int n = 1; n < max_threads; n *= 2)
+        counts.push_back(n);
+
+    counts.push_back(max_threads);
+
+    return counts;
+}
+
+// With a = 1 - 1/n and b = 1/speedup - 1/n, Amdahl's law reads b = f * a
+inline double fit_amdahl(const std::vector<scaling_point>& points)
+{
+    double sum_ab = 0.0;
+    double sum_aa = 0.0;
+
+    for (const auto& p : points)
+    {
+        if (p.threads < 2 || p.speedup <= 0.0)
+            continue;
+
+        const double a = 1.0 - 1.0 / p.threads;
+        const double b = 1.0 / p.speedup - 1.0 / p.threads;
+
+        sum_ab += a * b;
+        sum_aa += a * a;
+    }
+
+    return sum_aa > 0.0 ? sum_ab / sum_aa : 0.0;
+}
+
+inline scaling_curve make_scaling_curve(thread_placement placement, const std::vector<std::pair<int, score_summary>>& scores)
+{
+    scaling_curve curve;
+    curve.placement = placement;
+
+    const double base = scores.empty() ? 0.0 : (double)scores.front().second.score;
+
+    for (const auto& [threads, summary] : scores)
+    {
+        scaling_point p;
+        p.threads = threads;
+        p.runs = summary.runs();
+        p.score = summary.score;
+        p.relative_ci = summary.relative_ci();
+        p.speedup = base > 0.0 ? p.score / base : 0.0;
+        p.efficiency = p.speedup / threads;
+        p.serial_fraction = threads > 1 && p.speedup > 0.0 ? (1.0 / p.speedup - 1.0 / threads) / (1.0 - 1.0 / threads) : 0.0;
+
+        curve.points.push_back(p);
+    }
+
+    curve.amdahl_serial_fraction = fit_amdahl(curve.points);
+
+    return curve;
+}
+
+// Runs the benchmark loop at every scaling thread count for each placement, up to what the
+// placement can hold. The score of each point is the loop's summary score.
+inline std::vector<scaling_curve> run_scaling_sweep(const run_params params, const bench_type bench, const long long time, const int loops,
+    const std::vector<thread_placement>& placements)
+{
+    std::ostream& out = report_stream(params);
+    const cpu_topology& topology = get_cpu_topology();
+
+    std::vector<scaling_curve> curves;
+
+    for (const thread_placement placement : placements)
+    {
+        std::vector<std::pair<int, score_summary>> scores;
+
+        for (const int threads : scaling_thread_counts(topology.max_threads(placement)))
+        {
+            run_params p = params;
+            p.threads = threads;
+            p.placement = placement;
+
+            const score_summary summary = bench == bench_type::MULTISAMPLE ? run_multisample_loop(p, loops) : run_fixedtime_loop(p, time, loops);
+
+            scores.push_back({ threads, summary });
+        }
+
+        curves.push_back(make_scaling_curve(placement, scores));
+    }
+
+    out << "Thread Scaling" << std::endl;
+    out << "Logical CPUs:         " << topology.logical_count() << std::endl;
+    out << "Physical cores:       " << topology.core_count() << std::endl;
+    out << std::endl;
+
+    for (const auto& curve : curves)
+    {
+        out << "Thread placement:     " << thread_placement_to_string(curve.placement) << std::endl;
+
+        for (const auto& p : curve.points)
+        {
+            out << "  " << p.threads << (p.threads == 1 ? " thread:  " : " threads: ") << "score " << p.score
+                << " (+-" << p.relative_ci * 100 << "%), speedup " << p.speedup
+                << "x, efficiency " << p.efficiency * 100 << "%, serial fraction " << p.serial_fraction << std::endl;
+        }
+
+        out << "Amdahl serial frac:   " << curve.amdahl_serial_fraction << std::endl;
+        out << std::endl;
+    }
+
+    return curves;
+}
@@ -0,0 +1,423 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+
+// Runtime shapes: an inequality in x and y such as "x^2 + y^2 < 1" or "-1 < x < 1 && -1 < y < 1",
+// compiled to register bytecode. Value registers 0 and 1 hold x and y; comparisons write mask
+// registers, which && || ! combine. Supported: + - * / unary -, ^ with an integer exponent, abs(),
+// < <= > >= (chainable), && || ! and parentheses.
+
+enum class shape_op : uint8_t
+{
+    CONST,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    NEG,
+    ABS,
+    LT,
+    LE,
+    AND,
+    OR,
+    NOT
+};
+
+struct shape_instr
+{
+    shape_op op;
+    uint8_t dst;
+    uint8_t a;
+    uint8_t b;
+    float value;
+};
+
+constexpr int shape_max_registers = 16;
+
+struct shape_program
+{
+    std::string source;
+    std::vector<shape_instr> code;
+
+    int value_registers = 2;
+    int mask_registers = 0;
+
+    // Mask register holding the result
+    int result = 0;
+};
+
+class shape_parser
+{
+public:
+    explicit shape_parser(const std::string& source)
+        : src(source) {}
+
+    shape_program compile()
+    {
+        program = shape_program();
+        program.source = src;
+        pos = 0;
+        value_top = 2;
+        mask_top = 0;
+
+        const operand result = parse_or();
+
+        skip_space();
+        if (pos < src.size())
+            fail("unexpected '" + std::string(1, src[pos]) + "'");
+        if (!result.is_mask)
+            fail("shape expression must be a comparison");
+
+        program.result = result.reg;
+        return program;
+    }
+
+private:
+    struct operand
+    {
+        bool is_mask;
+        int reg;
+    };
+
+    [[noreturn]] void fail(const std::string& message) const
+    {
+        throw std::invalid_argument("Shape expression: " + message + " at position " + std::to_string(pos) + " in \"" + src + "\"");
+    }
+
+    void skip_space()
+    {
+        while (pos < src.size() && std::isspace((unsigned char)src[pos]))
+        {
+            pos++;
+        }
+    }
+
+    bool accept(const char* token)
+    {
+        skip_space();
+
+        const std::string t(token);
+        if (src.compare(pos, t.size(), t) != 0)
+            return false;
+
+        pos += t.size();
+        return true;
+    }
+
+    void expect(const char* token)
+    {
+        if (!accept(token))
+            fail(std::string("expected '") + token + "'");
+    }
+
+    int alloc_value()
+    {
+        if (value_top >= shape_max_registers)
+            fail("expression too deep");
+
+        program.value_registers = std::max(program.value_registers, value_top + 1);
+        return value_top++;
+    }
+
+    int alloc_mask()
+    {
+        if (mask_top >= shape_max_registers)
+            fail("expression too deep");
+
+        program.mask_registers = std::max(program.mask_registers, mask_top + 1);
+        return mask_top++;
+    }
+
+    // Registers are allocated as a stack, so releasing an operand frees everything above it
+    void release(const operand o)
+    {
+        if (o.is_mask)
+            mask_top = o.reg;
+        else if (o.reg >= 2)
+            value_top = o.reg;
+    }
+
+    // Results reuse the lowest temporary operand, otherwise a new register is taken
+    operand emit(const shape_op op, const operand a, const operand b, const bool mask_result)
+    {
+        operand dst;
+
+        if (mask_result)
+        {
+            if (!a.is_mask || !b.is_mask)
+                fail("expected a comparison");
+
+            if (b.reg != a.reg)
+                release(b);
+            dst = a;
+        }
+        else if (a.reg >= 2)
+        {
+            if (b.reg != a.reg)
+                release(b);
+            dst = a;
+        }
+        else if (b.reg >= 2)
+        {
+            dst = b;
+        }
+        else
+        {
+            dst = { false, alloc_value() };
+        }
+
+        program.code.push_back({ op, (uint8_t)dst.reg, (uint8_t)a.reg, (uint8_t)b.reg, 0.0f });
+        return dst;
+    }
+
+    operand need_value(const operand o)
+    {
+        if (o.is_mask)
+            fail("expected a number, not a comparison");
+        return o;
+    }
+
+    operand need_mask(const operand o)
+    {
+        if (!o.is_mask)
+            fail("expected a comparison");
+        return o;
+    }
+
+    operand parse_or()
+    {
+        operand a = parse_and();
+
+        while (accept("||"))
+        {
+            need_mask(a);
+            const operand b = need_mask(parse_and());
+            a = emit(shape_op::OR, a, b, true);
+        }
+
+        return a;
+    }
+
+    operand parse_and()
+    {
+        operand a = parse_not();
+
+        while (accept("&&"))
+        {
+            need_mask(a);
+            const operand b = need_mask(parse_not());
+            a = emit(shape_op::AND, a, b, true);
+        }
+
+        return a;
+    }
+
+    operand parse_not()
+    {
+        skip_space();
+
+        if (pos < src.size() && src[pos] == '!' && src.compare(pos, 2, "!=") != 0)
+        {
+            pos++;
+            const operand a = need_mask(parse_not());
+            return emit(shape_op::NOT, a, a, true);
+        }
+
+        return parse_compare();
+    }
+
+    // a < b < c is read as a < b && b < c; > and >= swap their operands into < and <=
+    operand parse_compare()
+    {
+        const int value_mark = value_top;
+
+        operand left = parse_sum();
+        operand result = { true, -1 };
+
+        for (;;)
+        {
+            shape_op op;
+            bool swap = false;
+
+            if (accept("<="))
+                op = shape_op::LE;
+            else if (accept(">="))
+                op = shape_op::LE, swap = true;
+            else if (accept("<"))
+                op = shape_op::LT;
+            else if (accept(">"))
+                op = shape_op::LT, swap = true;
+            else
+                break;
+
+            need_value(left);
+            const operand right = need_value(parse_sum());
+
+            const operand m = { true, alloc_mask() };
+            program.code.push_back({ op, (uint8_t)m.reg, (uint8_t)(swap ? right.reg : left.reg), (uint8_t)(swap ? left.reg : right.reg), 0.0f });
+
+            if (result.reg < 0)
+            {
+                result = m;
+            }
+            else
+            {
+                program.code.push_back({ shape_op::AND, (uint8_t)result.reg, (uint8_t)result.reg, (uint8_t)m.reg, 0.0f });
+                release(m);
+            }
+
+            // The right operand is the left operand of a chained comparison
+            left = right;
+        }
+
+        if (result.reg < 0)
+            return left;
+
+        value_top = value_mark;
+        return result;
+    }
+
+    operand parse_sum()
+    {
+        operand a = parse_product();
+
+        for (;;)
+        {
+            if (accept("+"))
+                a = emit(shape_op::ADD, need_value(a), need_value(parse_product()), false);
+            else if (accept("-"))
+                a = emit(shape_op::SUB, need_value(a), need_value(parse_product()), false);
+            else
+                return a;
+        }
+    }
+
+    operand parse_product()
+    {
+        operand a = parse_unary();
+
+        for (;;)
+        {
+            if (accept("*"))
+                a = emit(shape_op::MUL, need_value(a), need_value(parse_unary()), false);
+            else if (accept("/"))
+                a = emit(shape_op::DIV, need_value(a), need_value(parse_unary()), false);
+            else
+                return a;
+        }
+    }
+
+    operand parse_unary()
+    {
+        if (accept("-"))
+        {
+            const operand a = need_value(parse_unary());
+            return emit(shape_op::NEG, a, a, false);
+        }
+
+        return parse_power();
+    }
+
+    operand parse_power()
+    {
+        const operand base = parse_atom();
+
+        if (!accept("^"))
+            return base;
+
+        need_value(base);
+        skip_space();
+
+        char* end;
+        const long exponent = std::strtol(src.c_str() + pos, &end, 10);
+
+        if (end == src.c_str() + pos || exponent < 0 || exponent > 16)
+            fail("exponent must be an integer from 0 to 16");
+
+        pos = end - src.c_str();
+
+        if (exponent == 0)
+        {
+            release(base);
+            return constant(1.0f);
+        }
+
+        // Repeated multiplication keeps x^2 identical to x * x in the draw funcs. The first product
+        // goes to a new register so the base stays intact for the following ones.
+        operand result = base;
+
+        for (long i = 1; i < exponent; i++)
+        {
+            const operand dst = result.reg == base.reg ? operand{ false, alloc_value() } : result;
+            program.code.push_back({ shape_op::MUL, (uint8_t)dst.reg, (uint8_t)result.reg, (uint8_t)base.reg, 0.0f });
+            result = dst;
+        }
+
+        return result;
+    }
+
+    operand constant(const float value)
+    {
+        const operand dst = { false, alloc_value() };
+        program.code.push_back({ shape_op::CONST, (uint8_t)dst.reg, 0, 0, value });
+        return dst;
+    }
+
+    operand parse_atom()
+    {
+        skip_space();
+
+        if (pos >= src.size())
+            fail("unexpected end of expression");
+
+        const char c = src[pos];
+
+        if (std::isdigit((unsigned char)c) || c == '.')
+        {
+            char* end;
+            const float value = std::strtof(src.c_str() + pos, &end);
+            pos = end - src.c_str();
+            return constant(value);
+        }
+
+        if (accept("abs"))
+        {
+            expect("(");
+            const operand a = need_value(parse_or());
+            expect(")");
+            return emit(shape_op::ABS, a, a, false);
+        }
+
+        if (accept("x"))
+            return { false, 0 };
+        if (accept("y"))
+            return { false, 1 };
+
+        if (accept("("))
+        {
+            const operand a = parse_or();
+            expect(")");
+            return a;
+        }
+
+        fail("unexpected '" + std::string(1, c) + "'");
+    }
+
+    std::string src;
+    size_t pos = 0;
+
+    shape_program program;
+    int value_top = 2;
+    int mask_top = 0;
+};
+
+inline shape_program compile_shape(const std::string& source)
+{
+    return shape_parser(source).compile();
+}
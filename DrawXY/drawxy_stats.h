@@ -0,0 +1,314 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "drawxy_common.h"
+#include "drawxy_perf.h"
+
+// Log-linear (HDR style) histogram of nanosecond latencies. Values keep their top
+// sub_bucket_bits + 1 significant bits, so recorded values are within ~3% of the original.
+class latency_histogram
+{
+public:
+    static constexpr int sub_bucket_bits = 5;
+    static constexpr int sub_bucket_count = 1 << sub_bucket_bits;
+    static constexpr int bucket_count = (64 - sub_bucket_bits) * sub_bucket_count;
+
+    void record(const long long value)
+    {
+        const long long v = value > 0 ? value : 0;
+
+        counts[bucket_index(v)]++;
+        count++;
+        sum += v;
+
+        if (v < min)
+            min = v;
+        if (v > max)
+            max = v;
+    }
+
+    void merge(const latency_histogram& other)
+    {
+        for (int i = 0; i < bucket_count; i++)
+        {
+            counts[i] += other.counts[i];
+        }
+
+        count += other.count;
+        sum += other.sum;
+
+        if (other.min < min)
+            min = other.min;
+        if (other.max > max)
+            max = other.max;
+    }
+
+    // Midpoint of the bucket holding the p-th percentile, clamped to the recorded range
+    long long percentile(const double p) const
+    {
+        if (count == 0)
+            return 0;
+
+        long long target = (long long)(p / 100.0 * count + 0.5);
+        if (target < 1)
+            target = 1;
+
+        long long seen = 0;
+
+        for (int i = 0; i < bucket_count; i++)
+        {
+            seen += counts[i];
+
+            if (seen >= target)
+            {
+                const long long lo = bucket_lower(i);
+                const long long mid = lo + (bucket_lower(i + 1) - lo) / 2;
+
+                return mid < min ? min : mid > max ? max : mid;
+            }
+        }
+
+        return max;
+    }
+
+    long long count = 0;
+    long long sum = 0;
+    long long min = INT64_MAX;
+    long long max = 0;
+
+private:
+    static int bucket_index(const long long v)
+    {
+        if (v < sub_bucket_count)
+            return (int)v;
+
+        int msb = 0;
+        while ((v >> (msb + 1)) != 0)
+        {
+            msb++;
+        }
+
+        const int top = (int)(v >> (msb - sub_bucket_bits));
+        return (msb - sub_bucket_bits) * sub_bucket_count + top;
+    }
+
+    static long long bucket_lower(const int i)
+    {
+        if (i < sub_bucket_count)
+            return i;
+
+        return (long long)(sub_bucket_count + i % sub_bucket_count) << (i / sub_bucket_count - 1);
+    }
+
+    std::vector<long long> counts = std::vector<long long>(bucket_count);
+};
+
+// Written only by its own worker during a run, padded so workers never share a cache line
+struct alignas(64) thread_stats
+{
+    latency_histogram unit_latency;
+
+    long long busy_time = 0;
+    long long units = 0;
+
+    long long inside_units = 0;
+    long long outside_units = 0;
+
+    // Sum of unit values, only kept by tiled renders that do not hold the graph
+    double value_sum = 0.0;
+
+    // Hardware events of this worker's kernel calls, valid only when counters were requested and opened
+    perf_counts counters;
+};
+
+// Two sided 95% critical value of Student's t distribution
+inline double t_critical_95(const int df)
+{
+    static const double table[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+
+    if (df < 1)
+        return 0.0;
+    if (df <= 30)
+        return table[df - 1];
+    if (df <= 40)
+        return 2.021;
+    if (df <= 60)
+        return 2.000;
+    if (df <= 120)
+        return 1.980;
+
+    return 1.960;
+}
+
+inline double median_of(std::vector<double> values)
+{
+    if (values.empty())
+        return 0.0;
+
+    std::sort(values.begin(), values.end());
+    const size_t n = values.size();
+
+    return n % 2 == 1 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2.0;
+}
+
+// Scores of the measured runs of a loop. Runs further than outlier_k scaled MADs from the median
+// are rejected, mean, stddev and the confidence interval are taken over the remaining runs.
+struct score_summary
+{
+    std::vector<long long> scores;
+    std::vector<bool> outlier;
+
+    int warmup_runs = 0;
+    int outliers = 0;
+
+    double mean = 0.0;
+    double median = 0.0;
+    double stddev = 0.0;
+    double mad = 0.0;
+    long long max = 0;
+
+    // 95% confidence interval of the mean
+    double ci_low = 0.0;
+    double ci_high = 0.0;
+
+    // Reported score, chosen by the loop's score_statistic
+    long long score = 0;
+
+    int runs() const
+    {
+        return (int)scores.size();
+    }
+
+    // Half width of the confidence interval relative to the mean
+    double relative_ci() const
+    {
+        return mean > 0.0 ? (ci_high - ci_low) / 2.0 / mean : 0.0;
+    }
+};
+
+inline score_summary summarize_scores(const std::vector<long long>& scores, const double outlier_k, const score_statistic statistic)
+{
+    score_summary summary;
+    summary.scores = scores;
+    summary.outlier = std::vector<bool>(scores.size(), false);
+
+    if (scores.empty())
+        return summary;
+
+    std::vector<double> values(scores.begin(), scores.end());
+    const double median = median_of(values);
+
+    std::vector<double> deviations;
+    for (const double v : values)
+        deviations.push_back(std::abs(v - median));
+
+    // 1.4826 * MAD estimates the standard deviation of normally distributed scores
+    const double mad = median_of(deviations);
+    const double limit = outlier_k * 1.4826 * mad;
+
+    std::vector<double> inliers;
+
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (outlier_k > 0.0 && mad > 0.0 && deviations[i] > limit)
+        {
+            summary.outlier[i] = true;
+            summary.outliers++;
+        }
+        else
+        {
+            inliers.push_back(values[i]);
+        }
+    }
+
+    const size_t n = inliers.size();
+
+    double sum = 0.0;
+    for (const double v : inliers)
+        sum += v;
+
+    const double mean = sum / n;
+
+    double sum_sq = 0.0;
+    for (const double v : inliers)
+        sum_sq += (v - mean) * (v - mean);
+
+    const double stddev = n > 1 ? std::sqrt(sum_sq / (n - 1)) : 0.0;
+    const double half_width = n > 1 ? t_critical_95((int)n - 1) * stddev / std::sqrt((double)n) : 0.0;
+
+    summary.mean = mean;
+    summary.median = median_of(inliers);
+    summary.stddev = stddev;
+    summary.mad = mad;
+    summary.max = *std::max_element(scores.begin(), scores.end());
+    summary.ci_low = mean - half_width;
+    summary.ci_high = mean + half_width;
+
+    switch (statistic)
+    {
+    case score_statistic::MEAN:
+        summary.score = (long long)(summary.mean + 0.5);
+        break;
+    case score_statistic::MEDIAN:
+        summary.score = (long long)(summary.median + 0.5);
+        break;
+    case score_statistic::MAX:
+        summary.score = summary.max;
+        break;
+    }
+
+    return summary;
+}
+
+// Throughput at the start and end of a fixed time run, from the first and last quarter of its
+// timeline. The first interval includes ramp-up and is left out when there are enough intervals.
+struct throughput_trend
+{
+    double early_rate = 0.0;
+    double late_rate = 0.0;
+
+    // Relative change from early to late throughput
+    double change = 0.0;
+
+    bool throttled = false;
+};
+
+inline throughput_trend analyze_throughput(const std::vector<long long>& units, const std::vector<long long>& times, const double threshold)
+{
+    throughput_trend trend;
+
+    const int n = (int)units.size();
+    const int skip = n >= 8 ? 1 : 0;
+    const int window = (n - skip) / 4;
+
+    if (window < 1)
+        return trend;
+
+    const auto rate = [&](int begin, int end)
+    {
+        long long u = 0;
+        long long t = 0;
+
+        for (int i = begin; i < end; i++)
+        {
+            u += units[i];
+            t += times[i];
+        }
+
+        return t > 0 ? u * 1e9 / t : 0.0;
+    };
+
+    trend.early_rate = rate(skip, skip + window);
+    trend.late_rate = rate(n - window, n);
+    trend.change = trend.early_rate > 0.0 ? trend.late_rate / trend.early_rate - 1.0 : 0.0;
+    trend.throttled = trend.early_rate > 0.0 && trend.change < -threshold;
+
+    return trend;
+}
@@ -1,6 +1,118 @@
 #pragma once
 
 #include <vector>
+#include <string>
+
+#include "drawxy_common.h"
+#include "drawxy_stats.h"
+#include "drawxy_topology.h"
+#include "drawxy_tiles.h"
+#include "drawxy_memory.h"
+
+typedef float (*calc_avg_func)(int samples, float scale_x, float scale_y, float offset_x, float offset_y);
+typedef unit_class (*classify_func)(double scale_x, double scale_y, double offset_x, double offset_y);
+
+// Kernels of the double and mixed precision modes take the unit rectangle in double
+typedef float (*calc_avg_precise_func)(int samples, double scale_x, double scale_y, double offset_x, double offset_y);
+
+// Escape-time kernels also take their iteration limit
+typedef float (*calc_escape_func)(int max_iterations, int samples, double scale_x, double scale_y, double offset_x, double offset_y);
+
+// Sum of count stored values of a graph in one coverage format
+typedef double (*coverage_sum_func)(const void* data, long long count);
+
+// Coverage of each shape in a batch set over one unit, avg is indexed by graph_shape
+typedef void (*calc_batch_func)(unsigned set, int samples, float scale_x, float scale_y, float offset_x, float offset_y, float* avg);
+
+// Hit count of an image unit of a symmetric view minus the count of its representative unit, both
+// on the integer lattice. False when the image cannot be corrected exactly and has to be computed.
+typedef bool (*lattice_mirror_func)(int samples, float scale_x, float scale_y, float offset_x, float offset_y,
+    float image_offset_x, float image_offset_y, unit_transform transform, long long& delta);
+
+// Corrected images take the representative's hit count from its float value, which holds every
+// count exactly up to this many samples per axis
+constexpr int lattice_mirror_max_samples = 4096;
+
+struct shape_program;
+typedef float (*calc_program_func)(const shape_program& program, int samples, float scale_x, float scale_y, float offset_x, float offset_y);
+
+// Kernels of one instruction set build, indexed by sampling_kernel and graph_shape
+struct kernel_table
+{
+    vectorization_level vec_level;
+    calc_avg_func calc_avg[sampling_kernel_count][graph_shape_count];
+
+    // Row sweep kernels by accumulator count, indexed by row_sweep_variant
+    calc_avg_func calc_avg_rows_variant[row_sweep_variant_count][graph_shape_count];
+
+    classify_func classify[graph_shape_count];
+
+    // Row sweep kernels of the double and mixed precision modes
+    calc_avg_precise_func calc_avg_double[graph_shape_count];
+    calc_avg_precise_func calc_avg_mixed[graph_shape_count];
+
+    // Escape-time shapes with a runtime iteration limit, indexed by precision_mode and escape_shape_index
+    calc_escape_func calc_escape[precision_mode_count][escape_shape_count];
+
+    // Shape program interpreter, runs any compiled shape expression
+    calc_program_func calc_program;
+
+    // Row sweep of a set of shapes sharing one coordinate pass
+    calc_batch_func calc_batch;
+
+    // Graph mean reduction, indexed by coverage_format
+    coverage_sum_func coverage_sum[coverage_format_count];
+
+    symmetry_group symmetry[graph_shape_count];
+
+    // Shapes the span kernel solves, the others fall back to the row sweep
+    bool span[graph_shape_count];
+
+    // Shapes the integer lattice kernel evaluates in fixed point
+    bool lattice[graph_shape_count];
+
+    // Count corrections of axis mirrored units on the lattice, null for shapes without a lattice form
+    lattice_mirror_func lattice_mirror[graph_shape_count];
+};
+
+// Kernel that computes one unit: compiled for a built-in shape, in single or higher precision, an
+// escape-time kernel with its iteration limit, or the interpreter with its program. Units are passed
+// in double, single precision kernels round them to float.
+struct unit_kernel
+{
+    calc_avg_func calc = nullptr;
+    calc_avg_precise_func calc_precise = nullptr;
+    calc_escape_func calc_escape = nullptr;
+    int max_iterations = 0;
+    calc_program_func calc_program = nullptr;
+    const shape_program* program = nullptr;
+
+    unit_kernel(calc_avg_func calc)
+        : calc(calc) {}
+
+    unit_kernel(calc_avg_precise_func calc_precise)
+        : calc_precise(calc_precise) {}
+
+    unit_kernel(calc_escape_func calc_escape, int max_iterations)
+        : calc_escape(calc_escape), max_iterations(max_iterations) {}
+
+    unit_kernel(calc_program_func calc_program, const shape_program* program)
+        : calc_program(calc_program), program(program) {}
+
+    float operator()(int samples, double scale_x, double scale_y, double offset_x, double offset_y) const
+    {
+        if (calc_precise != nullptr)
+            return calc_precise(samples, scale_x, scale_y, offset_x, offset_y);
+
+        if (calc_escape != nullptr)
+            return calc_escape(max_iterations, samples, scale_x, scale_y, offset_x, offset_y);
+
+        if (program != nullptr)
+            return calc_program(*program, samples, (float)scale_x, (float)scale_y, (float)offset_x, (float)offset_y);
+
+        return calc(samples, (float)scale_x, (float)scale_y, (float)offset_x, (float)offset_y);
+    }
+};
 
 struct multisample_run_result
 {
@@ -8,6 +120,42 @@ struct multisample_run_result
     long long best_single_time;
     long long total_time;
 
+    long long inside_units = 0;
+    long long outside_units = 0;
+
+    // Units copied from a symmetric unit or corrected from its count instead of computed
+    long long mirrored_units = 0;
+
+    // Progressive renders: passes and the time the first preview was published, -1 otherwise.
+    // total_time is the time to the final pass.
+    int passes = 0;
+    long long first_preview_time = -1;
+
+    // Mean coverage over the graph
+    float avg_value = 0.0f;
+
+    // Merged latency of sampled units and the per-worker stats it came from
+    latency_histogram unit_latency;
+    std::vector<thread_stats> per_thread;
+
+    // Hardware events summed over all workers' kernel calls, with the reason when counters were requested but unavailable
+    perf_counts counters;
+    std::string counter_error;
+
+    // In-memory graphs: bytes stored and the time the mean reduction took, -1 for tiled renders
+    long long graph_bytes = 0;
+    long long reduce_time = -1;
+
+    // Mapping and first touch of the in-memory graphs, not part of total_time
+    graph_memory_stats memory;
+
+    // Tiled renders: image writer busy time, render time spent waiting for tile buffers and
+    // the flush after the last tile, -1 when the graph was held in memory
+    long long io_write_time = -1;
+    long long io_stall_time = -1;
+    long long io_flush_time = -1;
+    int peak_tiles_in_flight = 0;
+
     long long score() const
     {
         return 1e13 / total_time;
@@ -30,28 +178,129 @@ struct fixedtime_run_result
     long long count;
     long long time;
 
+    // Units completed in each sampling interval and the measured length of the interval in ns
+    std::vector<long long> timeline_units;
+    std::vector<long long> timeline_time;
+
+    throughput_trend trend;
+
+    // Mapping and first touch of the scratch graph, not part of the measured window
+    graph_memory_stats memory;
+
+    perf_counts counters;
+    std::string counter_error;
+
     long long score() const
     {
         return count * 1e10 / time;
     }
 };
 
+// How a run loop repeats runs: count runs are always measured after the warmup runs. With a
+// target_ci above 0 the loop continues until the 95% confidence interval of the mean is within
+// +-target_ci of the mean, or max_runs is reached.
+struct loop_policy
+{
+    int warmup = 1;
+    int max_runs = 50;
+    double target_ci = 0.0;
+
+    // Runs further than this many scaled MADs from the median are outliers, 0 keeps all runs
+    double outlier_k = 3.0;
+
+    score_statistic statistic = score_statistic::MEAN;
+};
+
 struct run_params
 {
+    graph_shape shape;
     vectorization_level vec_level;
+    sampling_kernel kernel;
+    cull_mode cull;
 
     long long samples;
     long long size;
 
     int threads;
+    int grain;
+
+    // Worker pinning, only applied when the topology can hold all threads
+    thread_placement placement = thread_placement::NONE;
+
+    // Pages of in-memory graphs, and whether graphs are kept in the pool between runs or mapped
+    // and faulted in again by every run
+    huge_page_mode huge_pages = huge_page_mode::NONE;
+    bool graph_pool = true;
+
+    // Runtime shape expression replacing shape when set, programs always run in single precision
+    const shape_program* program = nullptr;
+
+    precision_mode precision = precision_mode::SINGLE;
+
+    // Accumulators of single precision row sweep kernels, 0 for the default
+    int accumulators = 0;
 
-    run_params(vectorization_level vec_level, long long samples, long long size, int threads)
-        : vec_level(vec_level), samples(samples), size(size), threads(threads) {}
+    // Storage of the in-memory graph of multisample runs
+    coverage_format coverage = coverage_format::FLOAT32;
+
+    // Mirror units of symmetric shapes and views instead of computing them, off for pure compute benchmarks
+    bool symmetry = true;
+
+    // Render multisample runs in coarse to fine passes, not for tiled renders
+    bool progressive = false;
+
+    // Iteration limit of escape-time shapes
+    int max_iterations = escape_default_iterations;
+
+    // View of the graph: zoom 1 shows [-2, 2] on both axes, larger zooms magnify around the center
+    double zoom = 1.0;
+    double center_x = 0.0;
+    double center_y = 0.0;
+
+    loop_policy loop;
+
+    // Fixed time throughput sampling interval in ms, 0 disables the timeline
+    long long timeline_interval = 50;
+
+    // Late window throughput this fraction below early window throughput flags a run as throttled
+    double throttle_threshold = 0.1;
+
+    // Count hardware events around every kernel call, adds a few syscalls per unit
+    bool counters = false;
+
+    // Print the console report, off for unattended runs that only write records
+    bool verbose = true;
+
+    // Multisample runs render in tiles written to this image instead of holding the graph when set.
+    // tiles_in_flight bounds buffered tiles, 0 uses two per thread.
+    std::string image_path;
+    image_format image = image_format::PGM8;
+    int tile_size = 256;
+    int tiles_in_flight = 0;
+
+    run_params(graph_shape shape, vectorization_level vec_level, long long samples, long long size, int threads,
+        sampling_kernel kernel = sampling_kernel::FLAT_INDEX, cull_mode cull = cull_mode::NONE, int grain = 1)
+        : shape(shape), vec_level(vec_level), kernel(kernel), cull(cull), samples(samples), size(size), threads(threads), grain(grain) {}
     
     long long total_calculations() const
     {
         return (samples * size) * (samples * size);
     }
+
+    double view_scale() const
+    {
+        return 4.0 / zoom;
+    }
+
+    double view_offset_x() const
+    {
+        return center_x - view_scale() / 2;
+    }
+
+    double view_offset_y() const
+    {
+        return center_y - view_scale() / 2;
+    }
 };
 
 //struct graph_loop_params
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "drawxy_topology.h"
+
+// Persistent worker threads shared by all benchmark runs. Each run hands every participating worker
+// a contiguous range of unit indices as its own deque: the owner takes grain-sized chunks from the
+// front, idle workers steal the back half of another worker's remaining range.
+class thread_pool
+{
+public:
+    typedef std::function<void(int worker, long long begin, long long end)> chunk_func;
+
+    explicit thread_pool(int threads = 0)
+    {
+        reserve(threads);
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lk(m);
+            quit = true;
+        }
+        cv_start.notify_all();
+
+        for (auto& t : workers)
+        {
+            t.join();
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    int size() const
+    {
+        return (int)workers.size();
+    }
+
+    // Grows the pool to at least the given number of workers, only called between runs
+    void reserve(int threads)
+    {
+        while ((int)workers.size() < threads)
+        {
+            queues.push_back(std::make_unique<worker_queue>());
+            workers.emplace_back(&thread_pool::worker_loop, this, (int)workers.size());
+        }
+    }
+
+    // Pins worker i to cpus[i], workers beyond the list and all workers for an empty list are
+    // released to the OS. Only called between runs.
+    void pin(const std::vector<int>& cpus)
+    {
+        if (cpus.empty() && !pinned)
+            return;
+
+        reserve((int)cpus.size());
+
+        for (int w = 0; w < (int)workers.size(); w++)
+        {
+            pin_thread(workers[w], w < (int)cpus.size() ? cpus[w] : -1);
+        }
+
+        pinned = !cpus.empty();
+    }
+
+    // Starts job over units [0, count) on the first `threads` workers without waiting.
+    // Workers stop taking new chunks once stop is set.
+    void start(int threads, long long count, long long grain, const chunk_func& job, const std::atomic<bool>* stop = nullptr)
+    {
+        reserve(threads);
+
+        std::lock_guard<std::mutex> lk(m);
+
+        for (int w = 0; w < threads; w++)
+        {
+            std::lock_guard<std::mutex> lk_queue(queues[w]->m);
+            queues[w]->begin = count / threads * w;
+            queues[w]->end = w == threads - 1 ? count : count / threads * (w + 1);
+        }
+
+        current_job = &job;
+        current_grain = grain > 0 ? grain : 1;
+        current_stop = stop;
+        active = threads;
+        running = threads;
+        generation++;
+
+        cv_start.notify_all();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lk(m);
+        cv_done.wait(lk, [&] { return running == 0; });
+    }
+
+    void run(int threads, long long count, long long grain, const chunk_func& job, const std::atomic<bool>* stop = nullptr)
+    {
+        start(threads, count, grain, job, stop);
+        wait();
+    }
+
+private:
+    struct alignas(64) worker_queue
+    {
+        std::mutex m;
+        long long begin = 0;
+        long long end = 0;
+    };
+
+    void worker_loop(const int id)
+    {
+        long long seen = 0;
+
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lk(m);
+                cv_start.wait(lk, [&] { return quit || generation != seen; });
+
+                if (quit)
+                    return;
+
+                seen = generation;
+
+                if (id >= active)
+                    continue;
+            }
+
+            long long begin, end;
+
+            while (!(current_stop != nullptr && *current_stop) && (pop(id, begin, end) || steal(id, begin, end)))
+            {
+                (*current_job)(id, begin, end);
+            }
+
+            {
+                std::lock_guard<std::mutex> lk(m);
+
+                if (--running == 0)
+                    cv_done.notify_all();
+            }
+        }
+    }
+
+    bool pop(const int id, long long& begin, long long& end)
+    {
+        worker_queue& q = *queues[id];
+        std::lock_guard<std::mutex> lk(q.m);
+
+        if (q.begin >= q.end)
+            return false;
+
+        begin = q.begin;
+        end = q.end - q.begin > current_grain ? q.begin + current_grain : q.end;
+        q.begin = end;
+
+        return true;
+    }
+
+    bool steal(const int id, long long& begin, long long& end)
+    {
+        for (int i = 1; i < active; i++)
+        {
+            worker_queue& victim = *queues[(id + i) % active];
+            long long stolen_begin, stolen_end;
+
+            {
+                std::lock_guard<std::mutex> lk(victim.m);
+
+                const long long remaining = victim.end - victim.begin;
+
+                if (remaining <= 0)
+                    continue;
+
+                stolen_end = victim.end;
+                stolen_begin = remaining > current_grain ? victim.end - remaining / 2 : victim.begin;
+                victim.end = stolen_begin;
+            }
+
+            {
+                std::lock_guard<std::mutex> lk(queues[id]->m);
+                queues[id]->begin = stolen_begin;
+                queues[id]->end = stolen_end;
+            }
+
+            return pop(id, begin, end);
+        }
+
+        return false;
+    }
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<worker_queue>> queues;
+
+    std::mutex m;
+    std::condition_variable cv_start;
+    std::condition_variable cv_done;
+
+    long long generation = 0;
+    int active = 0;
+    int running = 0;
+    bool quit = false;
+    bool pinned = false;
+
+    const chunk_func* current_job = nullptr;
+    long long current_grain = 1;
+    const std::atomic<bool>* current_stop = nullptr;
+};
+
+// Pool shared across all runs, grown to the largest thread count requested so far
+inline thread_pool& get_thread_pool()
+{
+    static thread_pool pool;
+    return pool;
+}
@@ -0,0 +1,374 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// Coverage image written by tiled renders. PGM images have the top row first, raw files hold the
+// graph's float values in graph order (row y = 0 first) and are written through a memory mapping.
+enum class image_format
+{
+    PGM8,
+    PGM16,
+    RAW
+};
+
+inline std::string image_format_to_string(image_format obj)
+{
+    switch (obj)
+    {
+    case image_format::PGM8:
+        return "PGM [8 bit]";
+    case image_format::PGM16:
+        return "PGM [16 bit]";
+    case image_format::RAW:
+        return "Raw float [memory mapped]";
+    }
+}
+
+// Rectangle of units, in graph coordinates
+struct tile_rect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// Where a tile is rendered: unit (x, y) of the tile goes to data[x + y * stride]
+struct tile_buffer
+{
+    float* data;
+    long long stride;
+};
+
+// Receives finished tiles of a size x size graph. Raw files are rendered straight into the mapping.
+// PGM tiles are rendered into one of max_in_flight buffers and converted and written by a writer
+// thread, renderers only wait when every buffer is rendering or queued. Memory stays bounded by
+// max_in_flight tiles instead of the graph size.
+class tiled_image_writer
+{
+public:
+    tiled_image_writer(const std::string& path, image_format format, int size, int tile_size, int max_in_flight)
+        : path(path), format(format), size(size), tile_size(tile_size), max_in_flight(max_in_flight < 1 ? 1 : max_in_flight) {}
+
+    ~tiled_image_writer()
+    {
+        finish();
+    }
+
+    tiled_image_writer(const tiled_image_writer&) = delete;
+    tiled_image_writer& operator=(const tiled_image_writer&) = delete;
+
+    // Creates the file at its full size, false with error set when that fails
+    bool open()
+    {
+        if (format == image_format::RAW)
+            return open_mapping();
+
+        const int maxval = format == image_format::PGM8 ? 255 : 65535;
+        const std::string header = "P5\n" + std::to_string(size) + " " + std::to_string(size) + "\n" + std::to_string(maxval) + "\n";
+
+        header_size = (long long)header.size();
+        pixel_bytes = format == image_format::PGM8 ? 1 : 2;
+
+        file = std::fopen(path.c_str(), "wb");
+
+        if (file == nullptr)
+        {
+            error = "Cannot open image file " + path;
+            return false;
+        }
+
+        // Writing the last byte sizes the file, tiles are then written at their offsets in any order
+        const long long total = header_size + (long long)size * size * pixel_bytes;
+        const char zero = 0;
+
+        if (std::fwrite(header.data(), 1, header.size(), file) != header.size() || !seek(total - 1) || std::fwrite(&zero, 1, 1, file) != 1)
+        {
+            error = "Cannot write image file " + path;
+            return false;
+        }
+
+        buffers.resize(max_in_flight);
+        for (auto& b : buffers)
+        {
+            b.resize((size_t)tile_size * tile_size);
+            free_buffers.push_back(b.data());
+        }
+
+        writer = std::thread(&tiled_image_writer::writer_loop, this);
+
+        return true;
+    }
+
+    // Buffer for one tile, blocks while max_in_flight tiles are rendering or queued
+    tile_buffer acquire(const tile_rect& tile)
+    {
+        if (format == image_format::RAW)
+            return { mapped + tile.x + (long long)tile.y * size, size };
+
+        std::unique_lock<std::mutex> lk(m);
+
+        if (free_buffers.empty())
+        {
+            const auto begin_time = std::chrono::steady_clock::now();
+
+            cv_free.wait(lk, [&] { return !free_buffers.empty(); });
+
+            stall_time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin_time).count();
+        }
+
+        float* data = free_buffers.back();
+        free_buffers.pop_back();
+
+        const int in_flight = max_in_flight - (int)free_buffers.size();
+        peak_in_flight = in_flight > peak_in_flight ? in_flight : peak_in_flight;
+
+        return { data, tile.width };
+    }
+
+    // Hands a rendered tile to the writer thread
+    void submit(const tile_rect& tile, const tile_buffer buffer)
+    {
+        if (format == image_format::RAW)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lk(m);
+            queue.push_back({ tile, buffer.data });
+        }
+        cv_queue.notify_one();
+    }
+
+    // Waits for queued tiles and closes the file, true when everything was written
+    bool finish()
+    {
+        if (writer.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lk(m);
+                done = true;
+            }
+            cv_queue.notify_one();
+            writer.join();
+        }
+
+        if (file != nullptr)
+        {
+            if (std::fclose(file) != 0 && error.empty())
+                error = "Cannot write image file " + path;
+            file = nullptr;
+        }
+
+        close_mapping();
+
+        return error.empty();
+    }
+
+    // Time the writer thread spent converting and writing, and renderers spent waiting for buffers
+    long long write_time = 0;
+    long long stall_time = 0;
+    int peak_in_flight = 0;
+
+    std::string error;
+
+private:
+    struct tile_job
+    {
+        tile_rect tile;
+        float* data;
+    };
+
+    bool seek(const long long offset)
+    {
+#ifdef _WIN32
+        return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+        return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+    }
+
+    void writer_loop()
+    {
+        std::vector<uint8_t> row((size_t)tile_size * pixel_bytes);
+
+        for (;;)
+        {
+            tile_job job;
+
+            {
+                std::unique_lock<std::mutex> lk(m);
+                cv_queue.wait(lk, [&] { return !queue.empty() || done; });
+
+                if (queue.empty())
+                    return;
+
+                job = queue.front();
+                queue.pop_front();
+            }
+
+            const auto begin_time = std::chrono::steady_clock::now();
+
+            write_tile(job, row);
+
+            write_time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin_time).count();
+
+            {
+                std::lock_guard<std::mutex> lk(m);
+                free_buffers.push_back(job.data);
+            }
+            cv_free.notify_one();
+        }
+    }
+
+    // Rows of the tile go to image rows counted from the top, graph row y = 0 is the bottom row
+    void write_tile(const tile_job& job, std::vector<uint8_t>& row)
+    {
+        const tile_rect& t = job.tile;
+
+        for (int r = 0; r < t.height; r++)
+        {
+            const float* values = job.data + (long long)r * t.width;
+
+            for (int c = 0; c < t.width; c++)
+            {
+                const float v = values[c] < 0.0f ? 0.0f : values[c] > 1.0f ? 1.0f : values[c];
+
+                if (pixel_bytes == 1)
+                {
+                    row[c] = (uint8_t)std::lround(v * 255.0f);
+                }
+                else
+                {
+                    // 16 bit PGM samples are big endian
+                    const uint16_t p = (uint16_t)std::lround(v * 65535.0f);
+                    row[c * 2] = (uint8_t)(p >> 8);
+                    row[c * 2 + 1] = (uint8_t)(p & 0xff);
+                }
+            }
+
+            const long long image_row = size - 1 - (t.y + r);
+            const long long offset = header_size + (image_row * size + t.x) * pixel_bytes;
+
+            if (error.empty() && (!seek(offset) || std::fwrite(row.data(), pixel_bytes, t.width, file) != (size_t)t.width))
+                error = "Cannot write image file " + path;
+        }
+    }
+
+    bool open_mapping()
+    {
+        const long long bytes = (long long)size * size * sizeof(float);
+
+#ifdef _WIN32
+        file_handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        if (file_handle != INVALID_HANDLE_VALUE)
+        {
+            mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READWRITE, (DWORD)(bytes >> 32), (DWORD)(bytes & 0xffffffff), nullptr);
+
+            if (mapping_handle != nullptr)
+                mapped = (float*)MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, (SIZE_T)bytes);
+        }
+#else
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+        if (fd >= 0 && ftruncate(fd, (off_t)bytes) == 0)
+        {
+            void* p = mmap(nullptr, (size_t)bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            mapped = p == MAP_FAILED ? nullptr : (float*)p;
+        }
+#endif
+
+        if (mapped == nullptr)
+        {
+            error = "Cannot map image file " + path;
+            close_mapping();
+            return false;
+        }
+
+        mapped_bytes = bytes;
+
+        return true;
+    }
+
+    // Dirty pages are written back by the OS, closing only schedules what is left
+    void close_mapping()
+    {
+#ifdef _WIN32
+        if (mapped != nullptr)
+        {
+            FlushViewOfFile(mapped, 0);
+            UnmapViewOfFile(mapped);
+        }
+        if (mapping_handle != nullptr)
+            CloseHandle(mapping_handle);
+        if (file_handle != INVALID_HANDLE_VALUE)
+            CloseHandle(file_handle);
+
+        mapping_handle = nullptr;
+        file_handle = INVALID_HANDLE_VALUE;
+#else
+        if (mapped != nullptr)
+        {
+            msync(mapped, (size_t)mapped_bytes, MS_ASYNC);
+            munmap(mapped, (size_t)mapped_bytes);
+        }
+        if (fd >= 0)
+            ::close(fd);
+
+        fd = -1;
+#endif
+        mapped = nullptr;
+    }
+
+    std::string path;
+    image_format format;
+    int size;
+    int tile_size;
+    int max_in_flight;
+
+    long long header_size = 0;
+    int pixel_bytes = 1;
+    std::FILE* file = nullptr;
+
+    float* mapped = nullptr;
+    long long mapped_bytes = 0;
+#ifdef _WIN32
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping_handle = nullptr;
+#else
+    int fd = -1;
+#endif
+
+    std::vector<std::vector<float>> buffers;
+    std::vector<float*> free_buffers;
+    std::deque<tile_job> queue;
+    bool done = false;
+
+    std::mutex m;
+    std::condition_variable cv_free;
+    std::condition_variable cv_queue;
+    std::thread writer;
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Where pool workers run: left to the OS, packed onto SMT siblings of as few cores as possible,
+// or one worker per physical core
+enum class thread_placement
+{
+    NONE,
+    SMT_ON,
+    SMT_OFF
+};
+
+constexpr int thread_placement_count = 3;
+
+inline std::string thread_placement_to_string(thread_placement obj)
+{
+    switch (obj)
+    {
+    case thread_placement::NONE:
+        return "None [OS scheduled]";
+    case thread_placement::SMT_ON:
+        return "SMT on [siblings first]";
+    case thread_placement::SMT_OFF:
+        return "SMT off [one thread per core]";
+    }
+}
+
+// Logical CPUs the process may run on, grouped by physical core
+struct cpu_topology
+{
+    std::vector<std::vector<int>> cores;
+
+    int logical_count() const
+    {
+        int count = 0;
+        for (const auto& core : cores)
+            count += (int)core.size();
+        return count;
+    }
+
+    int core_count() const
+    {
+        return (int)cores.size();
+    }
+
+    int max_threads(thread_placement placement) const
+    {
+        return placement == thread_placement::SMT_OFF ? core_count() : logical_count();
+    }
+};
+
+inline cpu_topology detect_cpu_topology()
+{
+    cpu_topology topology;
+
+#ifdef _WIN32
+    // Only processor group 0 is considered
+    DWORD length = 0;
+    GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+
+    std::vector<char> buffer(length);
+    auto* info = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)buffer.data();
+
+    if (length > 0 && GetLogicalProcessorInformationEx(RelationProcessorCore, info, &length))
+    {
+        for (DWORD offset = 0; offset < length;)
+        {
+            const auto* entry = (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)(buffer.data() + offset);
+            const GROUP_AFFINITY& mask = entry->Processor.GroupMask[0];
+
+            if (mask.Group == 0)
+            {
+                std::vector<int> core;
+                for (int cpu = 0; cpu < (int)sizeof(KAFFINITY) * 8; cpu++)
+                {
+                    if (mask.Mask & ((KAFFINITY)1 << cpu))
+                        core.push_back(cpu);
+                }
+
+                if (!core.empty())
+                    topology.cores.push_back(core);
+            }
+
+            offset += entry->Size;
+        }
+    }
+#else
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+        // Cores keyed by package and core id, in order of their first logical CPU
+        std::map<std::pair<int, int>, int> core_index;
+
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (!CPU_ISSET(cpu, &allowed))
+                continue;
+
+            const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+            std::ifstream package_file(path + "physical_package_id");
+            std::ifstream core_file(path + "core_id");
+
+            int package = 0;
+            int core = cpu;
+
+            if (package_file && core_file)
+            {
+                package_file >> package;
+                core_file >> core;
+            }
+            else
+            {
+                package = -1;
+            }
+
+            const auto key = std::make_pair(package, core);
+            const auto it = core_index.find(key);
+
+            if (it == core_index.end())
+            {
+                core_index[key] = (int)topology.cores.size();
+                topology.cores.push_back({ cpu });
+            }
+            else
+            {
+                topology.cores[it->second].push_back(cpu);
+            }
+        }
+    }
+#endif
+
+    // Without topology every logical CPU counts as a core
+    if (topology.cores.empty())
+    {
+        const int count = std::thread::hardware_concurrency() > 0 ? (int)std::thread::hardware_concurrency() : 1;
+
+        for (int cpu = 0; cpu < count; cpu++)
+            topology.cores.push_back({ cpu });
+    }
+
+    return topology;
+}
+
+// Detected once, the topology does not change while benchmarking
+inline const cpu_topology& get_cpu_topology()
+{
+    static const cpu_topology topology = detect_cpu_topology();
+    return topology;
+}
+
+// Logical CPU for each of `threads` workers, empty for OS scheduling or when the placement
+// cannot hold that many threads
+inline std::vector<int> placement_cpus(const cpu_topology& topology, thread_placement placement, int threads)
+{
+    std::vector<int> cpus;
+
+    if (placement == thread_placement::NONE || threads > topology.max_threads(placement))
+        return cpus;
+
+    if (placement == thread_placement::SMT_OFF)
+    {
+        for (int c = 0; c < threads; c++)
+            cpus.push_back(topology.cores[c][0]);
+    }
+    else
+    {
+        for (const auto& core : topology.cores)
+        {
+            for (const int cpu : core)
+            {
+                if ((int)cpus.size() < threads)
+                    cpus.push_back(cpu);
+            }
+        }
+    }
+
+    return cpus;
+}
+
+// Pins a thread to one logical CPU, or releases it to all CPUs for cpu < 0
+inline bool pin_thread(std::thread& thread, int cpu)
+{
+#ifdef _WIN32
+    const DWORD_PTR mask = cpu >= 0 ? (DWORD_PTR)1 << cpu : ~(DWORD_PTR)0;
+    DWORD_PTR process_mask, system_mask;
+
+    if (cpu < 0 && GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+        return SetThreadAffinityMask(thread.native_handle(), process_mask) != 0;
+
+    return SetThreadAffinityMask(thread.native_handle(), mask) != 0;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (cpu >= 0)
+    {
+        CPU_SET(cpu, &set);
+    }
+    else if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    {
+        return false;
+    }
+
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#endif
+}
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "drawxy_common.h"
+#include "drawxy_structs.h"
+#include "drawxy_run.h"
+#include "drawxy_scaling.h"
+#include "drawxy_host.h"
+
+// Fastest settings found for one shape on one CPU. accumulators is 0 unless a row sweep variant won.
+struct tuned_settings
+{
+    graph_shape shape;
+    vectorization_level vec_level;
+    sampling_kernel kernel;
+    int accumulators;
+    int threads;
+    int grain;
+    long long score;
+};
+
+// Tuned settings of the CPU a run is on, one entry per shape
+struct tuning_profile
+{
+    std::string cpu_model;
+    std::vector<tuned_settings> entries;
+
+    const tuned_settings* find(graph_shape shape) const
+    {
+        for (const auto& e : entries)
+        {
+            if (e.shape == shape)
+                return &e;
+        }
+
+        return nullptr;
+    }
+
+    void set(const tuned_settings& settings)
+    {
+        for (auto& e : entries)
+        {
+            if (e.shape == settings.shape)
+            {
+                e = settings;
+                return;
+            }
+        }
+
+        entries.push_back(settings);
+    }
+};
+
+// Profiles of every CPU share one file, so a file copied between machines keeps each machine's settings
+constexpr const char* default_profile_path = "drawxy_profile.tsv";
+
+// Scheduler grains tried after the kernel and thread count are chosen
+constexpr int tuning_grains[] = { 1, 2, 4, 8, 16, 64 };
+
+// Enums are stored by their display names, which stay valid when enums are reordered
+template <typename E> bool parse_profile_value(const std::string& value, const int count, std::string (*to_string)(E), E& out)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (to_string((E)i) == value)
+        {
+            out = (E)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Tab separated lines of cpu model, shape, vec level, kernel, accumulators, threads, grain and score
+inline std::string format_profile_line(const std::string& cpu_model, const tuned_settings& s)
+{
+    std::ostringstream line;
+
+    line << cpu_model << '\t' << graph_shape_to_string(s.shape) << '\t' << vec_level_to_string(s.vec_level) << '\t'
+        << sampling_kernel_to_string(s.kernel) << '\t' << s.accumulators << '\t' << s.threads << '\t' << s.grain << '\t' << s.score;
+
+    return line.str();
+}
+
+inline bool parse_profile_line(const std::string& line, std::string& cpu_model, tuned_settings& s)
+{
+    std::vector<std::string> fields;
+    std::stringstream in(line);
+    std::string field;
+
+    while (std::getline(in, field, '\t'))
+        fields.push_back(field);
+
+    if (fields.size() != 8)
+        return false;
+
+    cpu_model = fields[0];
+
+    if (!parse_profile_value(fields[1], graph_shape_count, graph_shape_to_string, s.shape)
+        || !parse_profile_value(fields[2], vec_level_count, vec_level_to_string, s.vec_level)
+        || !parse_profile_value(fields[3], sampling_kernel_count, sampling_kernel_to_string, s.kernel))
+        return false;
+
+    try
+    {
+        s.accumulators = std::stoi(fields[4]);
+        s.threads = std::stoi(fields[5]);
+        s.grain = std::stoi(fields[6]);
+        s.score = std::stoll(fields[7]);
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+
+    return s.threads >= 1 && s.grain >= 1 && (s.accumulators == 0 || row_sweep_variant(s.accumulators) >= 0);
+}
+
+// Entries of cpu_model in the file, a missing file gives an empty profile. Lines that do not parse
+// are skipped, so profiles of later versions do not stop a run.
+inline tuning_profile load_profile(const std::string& path, const std::string& cpu_model)
+{
+    tuning_profile profile;
+    profile.cpu_model = cpu_model;
+
+    std::ifstream in(path);
+    std::string line;
+
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::string model;
+        tuned_settings s;
+
+        if (parse_profile_line(line, model, s) && model == cpu_model)
+            profile.set(s);
+    }
+
+    return profile;
+}
+
+// Rewrites the file with the profile's entries, lines of other CPUs are kept
+inline bool save_profile(const std::string& path, const tuning_profile& profile)
+{
+    std::vector<std::string> kept;
+
+    {
+        std::ifstream in(path);
+        std::string line;
+
+        while (std::getline(in, line))
+        {
+            std::string model;
+            tuned_settings s;
+
+            if (line.empty() || line[0] == '#' || !parse_profile_line(line, model, s) || model != profile.cpu_model)
+                kept.push_back(line);
+        }
+    }
+
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+
+    if (!out)
+        return false;
+
+    if (kept.empty() || kept.front() != "# DrawXY tuning profile")
+        out << "# DrawXY tuning profile" << std::endl;
+
+    for (const auto& line : kept)
+        out << line << std::endl;
+
+    for (const auto& e : profile.entries)
+        out << format_profile_line(profile.cpu_model, e) << std::endl;
+
+    return (bool)out;
+}
+
+// Called with the candidate settings and summary of every measured configuration
+typedef std::function<void(const tuned_settings& settings, const score_summary& summary)> tuning_callback;
+
+// Searches in three stages, each keeping the winner of the one before: every vec level up to max_level
+// with the flat kernel, each row sweep variant, span and lattice on one thread, then thread counts
+// 1, 2, 4, ... up to max_threads, then scheduler grains. Each configuration is scored by a quiet loop
+// of params' size, samples and loop policy.
+inline tuned_settings run_tuning(const run_params params, const int loops, const vectorization_level max_level, const int max_threads,
+    const tuning_callback& on_candidate = nullptr)
+{
+    std::ostream& out = report_stream(params);
+
+    tuned_settings best = { params.shape, params.vec_level, params.kernel, params.accumulators, 1, 1, -1 };
+
+    const auto measure = [&](tuned_settings s)
+    {
+        run_params p = params;
+        p.verbose = false;
+        p.vec_level = s.vec_level;
+        p.kernel = s.kernel;
+        p.accumulators = s.accumulators;
+        p.threads = s.threads;
+        p.grain = s.grain;
+
+        const score_summary summary = run_multisample_loop(p, loops);
+        s.score = summary.score;
+
+        out << "  " << vec_level_to_string(s.vec_level) << ", " << kernel_name(p) << ", " << s.threads
+            << (s.threads == 1 ? " thread" : " threads") << ", grain " << s.grain << ": score " << s.score << std::endl;
+
+        if (on_candidate)
+            on_candidate(s, summary);
+
+        if (s.score > best.score)
+            best = s;
+    };
+
+    out << "Autotune" << std::endl;
+    out << "Shape:                " << graph_shape_to_string(params.shape) << std::endl;
+    out << "Samples Per Unit:     " << params.samples << std::endl;
+    out << "Display Size:         " << params.size << std::endl;
+
+    // Escape-time and double precision kernels have no variants, the scalar row sweep has one
+    const bool variants = params.precision == precision_mode::SINGLE && !is_escape_shape(params.shape);
+
+    for (int l = 0; l <= (int)max_level; l++)
+    {
+        const vectorization_level vl = (vectorization_level)l;
+
+        if (!variants)
+        {
+            measure({ params.shape, vl, sampling_kernel::ROW_SWEEP, 0, 1, 1, 0 });
+            continue;
+        }
+
+        measure({ params.shape, vl, sampling_kernel::FLAT_INDEX, 0, 1, 1, 0 });
+
+        if (vl == vectorization_level::NONE)
+        {
+            measure({ params.shape, vl, sampling_kernel::ROW_SWEEP, 0, 1, 1, 0 });
+
+            if (select_span(vl, params.shape))
+                measure({ params.shape, vl, sampling_kernel::SPAN, 0, 1, 1, 0 });
+            if (select_lattice(vl, params.shape))
+                measure({ params.shape, vl, sampling_kernel::LATTICE, 0, 1, 1, 0 });
+            continue;
+        }
+
+        for (int v = 0; v < row_sweep_variant_count; v++)
+            measure({ params.shape, vl, sampling_kernel::ROW_SWEEP, row_sweep_variant_accumulators[v], 1, 1, 0 });
+
+        if (select_span(vl, params.shape))
+            measure({ params.shape, vl, sampling_kernel::SPAN, 0, 1, 1, 0 });
+        if (select_lattice(vl, params.shape))
+            measure({ params.shape, vl, sampling_kernel::LATTICE, 0, 1, 1, 0 });
+    }
+
+    const tuned_settings kernel_best = best;
+
+    for (const int threads : scaling_thread_counts(max_threads))
+    {
+        if (threads > 1)
+            measure({ kernel_best.shape, kernel_best.vec_level, kernel_best.kernel, kernel_best.accumulators, threads, 1, 0 });
+    }
+
+    const tuned_settings threads_best = best;
+
+    for (const int grain : tuning_grains)
+    {
+        if (grain > 1)
+            measure({ threads_best.shape, threads_best.vec_level, threads_best.kernel, threads_best.accumulators, threads_best.threads, grain, 0 });
+    }
+
+    run_params winner = params;
+    winner.kernel = best.kernel;
+    winner.accumulators = best.accumulators;
+
+    out << "Best:                 " << vec_level_to_string(best.vec_level) << ", " << kernel_name(winner) << ", " << best.threads
+        << (best.threads == 1 ? " thread" : " threads") << ", grain " << best.grain << ", score " << best.score << std::endl;
+    out << std::endl;
+
+    return best;
+}